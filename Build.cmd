@@ -21,17 +21,50 @@ set SDCC_OPTS=-c -mz80 --opt-code-size --verbose --no-std-crt0
 set SDCC_OPTS=%SDCC_OPTS% --max-allocs-per-node 100000
 
 sdasz80 -fflopz ucrt0.s
+sdasz80 -fflopz ovlfmt.s
+sdasz80 -fflopz fatunz.s
 
 sdcc %SDCC_OPTS% char_cpm.c
 sdcc %SDCC_OPTS% bios.c
 sdcc %SDCC_OPTS% bdos.c
 sdcc %SDCC_OPTS% ff.c
+sdcc %SDCC_OPTS% ffmkfs.c
+sdcc %SDCC_OPTS% ffz80.c
 sdcc %SDCC_OPTS% diskio.c
+sdcc %SDCC_OPTS% cpmdsk.c
 sdcc %SDCC_OPTS% fat.c
 sdcc %SDCC_OPTS% fatiotst.c
 
-sdldz80 -mxi -b _CODE=0x0100 -k %SDCC_HOME%\lib\z80 -l z80 fat ucrt0.rel char_cpm.rel bios.rel bdos.rel ff.rel diskio.rel fat.rel
-makebin -p -o 0x100 -s 0x10000 fat.ihx fat.com
+sdldz80 -mxi -b _CODE=0x0100 -k %SDCC_HOME%\lib\z80 -l z80 fat ucrt0.rel char_cpm.rel bios.rel bdos.rel ff.rel ffz80.rel diskio.rel cpmdsk.rel fat.rel
+makebin -p -o 0x100 -s 0x10000 fat.ihx fat.bin
+
+:: FAT.COM is fat.bin packed behind the startup stub (fatunz.s) that
+:: unpacks it at load time, plain fat.bin is used if packing fails
+sdldz80 -mxi -b _CODE=0x0100 fatunz fatunz.rel
+makebin -p -o 0x100 fatunz.ihx fatunz.bin
+powershell -NoProfile -ExecutionPolicy Bypass -File fatpack.ps1 fatunz.bin fat.bin fat.com
+if errorlevel 1 copy /y fat.bin fat.com
+
+:: FORMAT overlay (f_mkfs) is linked to run at heap_start of FAT.COM and
+:: resolves its calls with the global symbols listed in fat.map
+set OVL_BASE=
+for /f "tokens=1" %%a in ('findstr /r /c:"^  *[0-9A-F][0-9A-F]*  *_heap_start " fat.map') do set OVL_BASE=0x%%a
+if "%OVL_BASE%"=="" (echo _heap_start not found in fat.map & exit /b 1)
+
+(
+echo -mxi
+echo -i fatfmt.ihx
+echo -b _CODE = %OVL_BASE%
+for /f "tokens=1,2" %%a in ('findstr /r /c:"^  *[0-9A-F][0-9A-F]*  *_[A-Za-z0-9_]" fat.map') do echo -g %%b = 0x%%a
+echo -k %SDCC_HOME%\lib\z80
+echo -l z80
+echo ovlfmt.rel
+echo ffmkfs.rel
+echo -e
+) > fatfmt.lk
+
+sdldz80 -nf fatfmt.lk
+makebin -p -o %OVL_BASE% -s 0x10000 fatfmt.ihx fatfmt.ovl
 
 sdldz80 -mxi -b _CODE=0x0100 -k %SDCC_HOME%\lib\z80 -l z80 fatiotst ucrt0.rel char_cpm.rel bios.rel bdos.rel diskio.rel fatiotst.rel
 makebin -p -o 0x100 fatiotst.ihx fatiotst.com
@@ -5,6 +5,8 @@ if exist *.rel del *.rel
 if exist *.lst del *.lst
 if exist *.sym del *.sym
 if exist *.com del *.com
+if exist *.bin del *.bin
+if exist *.ovl del *.ovl
 if exist *.hex del *.hex
 if exist *.ihx del *.ihx
 if exist *.lk del *.lk
@@ -12,6 +12,7 @@ WORD bdoscall(BYTE fn, WORD parm) __naked;
 #define BDOS_DIRIO(ch) (BYTE)bdoscall(6, ch)
 #define BDOS_PRTSTR(str) (BYTE)bdoscall(9, (WORD)str)
 #define BDOS_GETVER() (WORD)bdoscall(12, 0)
+#define BDOS_SELDISK(drv) (BYTE)bdoscall(14, drv)
 #define BDOS_OPENFILE(fcb) (BYTE)bdoscall(15, fcb)
 #define BDOS_CLOSEFILE(fcb) (BYTE)bdoscall(16, fcb)
 #define BDOS_FINDFIRST(fcb) (BYTE)bdoscall(17, fcb)
@@ -20,8 +21,13 @@ WORD bdoscall(BYTE fn, WORD parm) __naked;
 #define BDOS_READSEQ(fcb) (BYTE)bdoscall(20, fcb)
 #define BDOS_WRITESEQ(fcb) (BYTE)bdoscall(21, fcb)
 #define BDOS_MAKEFILE(fcb) (BYTE)bdoscall(22, fcb)
+#define BDOS_GETDISK() (BYTE)bdoscall(25, 0)
 #define BDOS_SETDMA(dma) (BYTE)bdoscall(26, dma)
 #define BDOS_GETALLOC() (WORD)bdoscall(27, 0)
+#define BDOS_GETDPB() (WORD)bdoscall(31, 0)
+#define BDOS_USERCODE(user) (BYTE)bdoscall(32, user)
+#define BDOS_FILESIZE(fcb) (BYTE)bdoscall(35, fcb)
+#define BDOS_RESETDRV(vec) (BYTE)bdoscall(37, vec)
 
 typedef struct {
 	BYTE drv;		// Drive code
@@ -106,3 +106,83 @@ loop2:
 
 	__endasm;
 }
+
+BYTE dskread(DWORD lba, BYTE * buf, UINT cnt, BYTE unit) __sdcccall(0) __naked
+{
+	lba;
+	buf;
+	cnt;
+	unit;
+
+	__asm
+
+	ld		a,#0x13			; HBIOS Disk Read
+
+dskio:
+	// Stack: func, ret, lba (4), buf (2), cnt (2), unit (1)
+	push	af				; save transfer function
+
+	// Seek to LBA
+	ld		hl,#12
+	add		hl,sp
+	ld		c,(hl)			; C := unit
+	ld		hl,#4
+	add		hl,sp
+	ld		a,(hl)
+	inc		hl
+	ld		b,(hl)
+	inc		hl
+	ld		e,(hl)
+	inc		hl
+	ld		d,(hl)			; DE := LBA high word
+	ld		h,b
+	ld		l,a				; HL := LBA low word
+	set		7,d				; high bit signifies LBA address
+	ld		b,#0x12			; HBIOS Disk Seek
+	rst		8
+	or		a
+	jr		nz,dskio1		; seek failed
+
+	// Transfer sectors
+	ld		hl,#12
+	add		hl,sp
+	ld		c,(hl)			; C := unit
+	ld		hl,#10
+	add		hl,sp
+	ld		e,(hl)
+	inc		hl
+	ld		d,(hl)			; DE := sector count
+	ld		hl,#8
+	add		hl,sp
+	ld		a,(hl)
+	inc		hl
+	ld		h,(hl)
+	ld		l,a				; HL := buffer
+	pop		af
+	ld		b,a				; B := HBIOS Read or Write
+	rst		8
+	ld		l,a				; return HBIOS result
+	ret
+
+dskio1:
+	pop		bc				; discard transfer function
+	ld		l,a				; return HBIOS result
+	ret
+
+	__endasm;
+}
+
+BYTE dskwrite(DWORD lba, const BYTE * buf, UINT cnt, BYTE unit) __sdcccall(0) __naked
+{
+	lba;
+	buf;
+	cnt;
+	unit;
+
+	__asm
+
+	ld		a,#0x14			; HBIOS Disk Write
+	jp		dskio			; common seek and transfer in dskread
+
+	__endasm;
+}
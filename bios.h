@@ -36,4 +36,10 @@ typedef union
 BYTE chkbios(void) __naked;
 void bioscall(REGS *out, REGS *in) __sdcccall(0) __naked;
 
+// Combined HBIOS seek + read/write, returns HBIOS result code.
+// Unit is passed last so its single byte stack slot does not
+// shift the other parameters.
+BYTE dskread(DWORD lba, BYTE * buf, UINT cnt, BYTE unit) __sdcccall(0) __naked;
+BYTE dskwrite(DWORD lba, const BYTE * buf, UINT cnt, BYTE unit) __sdcccall(0) __naked;
+
 #endif /* _BIOS_H */
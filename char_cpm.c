@@ -1,11 +1,40 @@
 #include "bdos.h"
 #include "stdio.h"
+#include "char_cpm.h"
+
+#define CONBUFSZ 128		// Console output written per BDOS call
+
+static char szConBuf[CONBUFSZ + 1];	// Pending console output (+ '$')
+static BYTE nConBuf;			// Chars in szConBuf
+
+void conflush(void)
+{
+	if (nConBuf == 0)
+		return;
+
+	szConBuf[nConBuf] = '$';	// BDOS print string ends at '$'...
+	BDOS_PRTSTR(szConBuf);		//... and checks for ^S/^C like CONOUT
+	nConBuf = 0;
+}
 
 int putchar(int ch)
 {
+	if (ch == '$')			// can't be part of a print string
+	{
+		conflush();
+		BDOS_CONOUT(ch);
+		return(ch);
+	}
+
 	if (ch == 10)			// if LF
-		BDOS_CONOUT(13);	//... insert CR
-	BDOS_CONOUT(ch);
+	{
+		conflush();		//... write out the finished line
+		szConBuf[nConBuf++] = 13;	//... insert CR
+	}
+	szConBuf[nConBuf++] = ch;
+
+	if (nConBuf >= CONBUFSZ)
+		conflush();
 
 	return(ch);
 }
@@ -14,6 +43,8 @@ int getchar(void)
 {
 	int ch;
 
+	conflush();			// show prompt before waiting
+
 	while (!(ch = BDOS_DIRIO(0xFF)));
 	if (ch == 13) return 10;
 	if (ch == 10) return 13;
@@ -0,0 +1,10 @@
+#ifndef _CHAR_CPM_H
+#define _CHAR_CPM_H
+
+// Console output of putchar() is buffered and written through BDOS
+// at each line end, when the buffer is full, before getchar() waits
+// for input and at program exit (ucrt0.s).
+
+void conflush(void);	// Write buffered console output now
+
+#endif /* _CHAR_CPM_H */
@@ -0,0 +1,605 @@
+/**********************************************************************
+
+Direct CP/M filesystem access for RomWBW hard disk slices
+
+The CP/M directory and allocation blocks of a slice are read with
+HBIOS sector calls (the same ones diskio.c uses for FatFs) so file
+data can be moved in multi-sector transfers instead of one BDOS
+record at a time.
+
+LICENSE:
+	GNU GPLv3 (see file LICENSE.txt)
+
+**********************************************************************/
+
+#include <string.h>
+
+#include "bios.h"
+#include "bdos.h"
+#include "cpmdsk.h"
+
+#define CBX_OFS 0x33		// CBIOS extension data follows 17 jump vectors
+#define CBX_DRVMAP 2		// Offset of drive map address within extension
+
+#define HD512_SLICE 16640UL	// Sectors per legacy (hd512) slice
+#define HD1K_SLICE 16384UL	// Sectors per modern (hd1k) slice
+#define HD1K_PTYPE 0x2E		// MBR partition type holding hd1k slices
+
+#define DIRLEN 32			// Size of a CP/M directory entry
+#define NODENT 0xFFFF		// No directory entry assigned yet
+
+static FRESULT cpm_flush(CPMVOL * vol)
+{
+	if (vol->wflag)
+	{
+		if (dskwrite(vol->winsect, vol->win, 1, vol->unit))
+			return FR_DISK_ERR;
+		vol->wflag = 0;
+	}
+
+	return FR_OK;
+}
+
+static BYTE * cpm_dirent(CPMVOL * vol, WORD idx)
+{
+	DWORD sect;
+
+	sect = vol->base + (idx >> 4);		// 16 entries per sector
+
+	if (sect != vol->winsect)
+	{
+		if (cpm_flush(vol) != FR_OK)
+			return NULL;
+		if (dskread(sect, vol->win, 1, vol->unit))
+			return NULL;
+		vol->winsect = sect;
+	}
+
+	return vol->win + ((idx & 15) * DIRLEN);
+}
+
+static BYTE cpm_match(CPMVOL * vol, const BYTE * dent, const BYTE * name)
+{
+	BYTE i;
+
+	if (dent[0] != vol->user)
+		return 0;
+
+	for (i = 0; i < 11; i++)
+		if ((dent[i + 1] & 0x7F) != name[i])
+			return 0;
+
+	return 1;
+}
+
+static WORD cpm_block(CPMFIL * fp, BYTE i)
+{
+	if (fp->vol->wide)
+		return fp->map[i << 1] | (fp->map[(i << 1) + 1] << 8);
+
+	return fp->map[i];
+}
+
+static void cpm_setblock(CPMFIL * fp, BYTE i, WORD blk)
+{
+	if (fp->vol->wide)
+	{
+		fp->map[i << 1] = (BYTE)blk;
+		fp->map[(i << 1) + 1] = (BYTE)(blk >> 8);
+	}
+	else
+		fp->map[i] = (BYTE)blk;
+}
+
+static void cpm_mark(CPMVOL * vol, const BYTE * dent, BYTE used)
+{
+	WORD blk;
+	BYTE i;
+
+	// Set or clear the blocks of a directory entry in alv[]
+	for (i = 0; i < 16; i++)
+	{
+		if (vol->wide)
+		{
+			blk = dent[16 + i] | (dent[17 + i] << 8);
+			i++;
+		}
+		else
+			blk = dent[16 + i];
+
+		if ((blk == 0) || (blk > vol->dsm))
+			continue;
+
+		if (used)
+			vol->alv[blk >> 3] |= (1 << (blk & 7));
+		else
+			vol->alv[blk >> 3] &= ~(1 << (blk & 7));
+	}
+}
+
+static FRESULT cpm_alvinit(CPMVOL * vol)
+{
+	BYTE * dent;
+	WORD idx;
+
+	// Directory blocks are reserved by AL0/AL1, file blocks are
+	// found by a single pass over the directory
+	memset(vol->alv, 0, sizeof(vol->alv));
+
+	for (idx = 0; idx < 16; idx++)
+		if (vol->al & (0x8000 >> idx))
+			vol->alv[idx >> 3] |= (1 << (idx & 7));
+
+	for (idx = 0; idx <= vol->drm; idx++)
+	{
+		dent = cpm_dirent(vol, idx);
+		if (dent == NULL)
+			return FR_DISK_ERR;
+
+		// User areas only, skips free, label, and time stamp entries
+		if (dent[0] < 0x20)
+			cpm_mark(vol, dent, 1);
+	}
+
+	vol->alvok = 1;
+
+	return FR_OK;
+}
+
+static WORD cpm_alloc(CPMVOL * vol, WORD hint)
+{
+	WORD blk, n;
+
+	// First free block at or after hint, wrapping to the start
+	blk = (hint > vol->dsm) ? 0 : hint;
+
+	for (n = 0; n <= vol->dsm; n++)
+	{
+		if (!(vol->alv[blk >> 3] & (1 << (blk & 7))))
+		{
+			vol->alv[blk >> 3] |= (1 << (blk & 7));
+			return blk;
+		}
+		blk = (blk < vol->dsm) ? blk + 1 : 0;
+	}
+
+	return 0;	// Block 0 always holds the directory
+}
+
+static FRESULT cpm_putext(CPMFIL * fp)
+{
+	CPMVOL * vol;
+	BYTE * dent;
+	WORD x;
+
+	vol = fp->vol;
+
+	if (fp->dent == NODENT)
+	{
+		// Claim a free directory entry
+		for (fp->dent = vol->dfree; fp->dent <= vol->drm; fp->dent++)
+		{
+			dent = cpm_dirent(vol, fp->dent);
+			if (dent == NULL)
+				return FR_DISK_ERR;
+			if (dent[0] == 0xE5)
+				break;
+		}
+
+		if (fp->dent > vol->drm)
+		{
+			fp->dent = NODENT;
+			return FR_DENIED;		// Directory full
+		}
+
+		vol->dfree = fp->dent + 1;
+	}
+
+	dent = cpm_dirent(vol, fp->dent);
+	if (dent == NULL)
+		return FR_DISK_ERR;
+
+	// Last logical extent used and its record count
+	x = fp->rec ? fp->ext + ((fp->rec - 1) >> 7) : fp->ext;
+
+	dent[0] = vol->user;
+	memcpy(dent + 1, fp->name, 11);
+	dent[12] = x & 0x1F;
+	dent[13] = 0;
+	dent[14] = x >> 5;
+	dent[15] = fp->rec - ((x - fp->ext) << 7);
+	memcpy(dent + 16, fp->map, sizeof(fp->map));
+
+	vol->wflag = 1;
+	vol->dirty = 1;
+
+	return FR_OK;
+}
+
+static FRESULT cpm_extent(CPMFIL * fp, WORD ext)
+{
+	CPMVOL * vol;
+	BYTE * dent;
+	WORD idx, n, x;
+
+	vol = fp->vol;
+	idx = fp->dent;
+
+	// The extents of a file are almost always consecutive in
+	// the directory, so search onward from the previous one
+	for (n = 0; n <= vol->drm; n++)
+	{
+		idx = (idx < vol->drm) ? idx + 1 : 0;
+
+		dent = cpm_dirent(vol, idx);
+		if (dent == NULL)
+			return FR_DISK_ERR;
+
+		if (!cpm_match(vol, dent, fp->name))
+			continue;
+
+		// Logical extent number (S2:EX), each entry holds exm + 1
+		x = ((WORD)dent[14] << 5) | (dent[12] & 0x1F);
+		if ((x & ~vol->exm) != ext)
+			continue;
+
+		fp->ext = ext;
+		fp->dent = idx;
+		fp->rec = 0;
+		fp->nrec = ((x & vol->exm) << 7) + dent[15];
+		memcpy(fp->map, dent + 16, sizeof(fp->map));
+
+		return FR_OK;
+	}
+
+	return FR_NO_FILE;
+}
+
+FRESULT cpm_mount(CPMVOL * vol, BYTE drv)
+{
+	BYTE * map;
+	BYTE * dpb;
+	BYTE * pte;
+	WORD dph;
+	WORD off;
+	BYTE slice;
+	BYTE cur;
+	BYTE n;
+	DWORD sect;
+
+	// RomWBW CBIOS extension data follows the BIOS jump table and
+	// points to the drive map: a count byte followed by 4 byte
+	// entries of HBIOS unit, slice, and DPH address
+	map = (BYTE *)*(WORD *)(*(WORD *)0x0001 - 3 + CBX_OFS + CBX_DRVMAP);
+	if ((map == NULL) || (drv >= map[-1]))
+		return FR_INVALID_DRIVE;
+
+	map += drv << 2;
+	dph = *(WORD *)(map + 2);
+	if (dph == 0)
+		return FR_INVALID_DRIVE;
+
+	vol->drv = drv;
+	vol->unit = map[0];
+	slice = map[1];
+	dpb = (BYTE *)*(WORD *)(dph + 10);
+
+	// Only trust the map if BDOS reports the same DPB for the drive
+	cur = BDOS_GETDISK();
+	BDOS_SELDISK(drv);
+	n = (BDOS_GETDPB() == (WORD)dpb);
+	BDOS_SELDISK(cur);
+	if (!n)
+		return FR_INVALID_DRIVE;
+
+	// RomWBW hard disk slices have 16 x 512 byte sectors (64
+	// records) per track and 512 (hd512) or 1024 (hd1k) entries
+	vol->bsh = dpb[2];
+	vol->exm = dpb[4];
+	vol->dsm = *(WORD *)(dpb + 5);
+	vol->drm = *(WORD *)(dpb + 7);
+	vol->al = (dpb[9] << 8) | dpb[10];
+	off = *(WORD *)(dpb + 13);
+	vol->wide = (vol->dsm > 255);
+
+	if ((*(WORD *)dpb != 64) || (vol->bsh < 3) || (vol->bsh > 7) ||
+		(vol->dsm >= CPM_MAXBLK))
+		return FR_NO_FILESYSTEM;
+
+	if (vol->drm == 511)
+		sect = slice * HD512_SLICE;
+	else if (vol->drm == 1023)
+	{
+		// hd1k slices are packed into a dedicated partition
+		if (dskread(0, vol->win, 1, vol->unit))
+			return FR_DISK_ERR;
+
+		if ((vol->win[510] != 0x55) || (vol->win[511] != 0xAA))
+			return FR_NO_FILESYSTEM;
+
+		for (n = 0, pte = vol->win + 446; n < 4; n++, pte += 16)
+			if (pte[4] == HD1K_PTYPE)
+				break;
+		if (n >= 4)
+			return FR_NO_FILESYSTEM;
+
+		sect = ((DWORD)*(WORD *)(pte + 10) << 16) | *(WORD *)(pte + 8);
+		sect += slice * HD1K_SLICE;
+	}
+	else
+		return FR_NO_FILESYSTEM;
+
+	vol->base = sect + ((DWORD)off << 4);
+	vol->winsect = 0xFFFFFFFF;
+	vol->wflag = 0;
+	vol->dirty = 0;
+	vol->alvok = 0;
+	vol->dfree = 0;
+	vol->user = BDOS_USERCODE(0xFF);
+
+	return FR_OK;
+}
+
+FRESULT cpm_unmount(CPMVOL * vol)
+{
+	FRESULT fr;
+
+	fr = cpm_flush(vol);
+
+	// BDOS holds its own allocation vector for a logged in
+	// drive, make it log in again after direct changes
+	if (vol->dirty)
+		BDOS_RESETDRV((WORD)1 << vol->drv);
+	vol->dirty = 0;
+
+	return fr;
+}
+
+FRESULT cpm_open(CPMFIL * fp, CPMVOL * vol, const BYTE * name)
+{
+	BYTE n;
+
+	fp->vol = vol;
+
+	for (n = 0; n < 11; n++)
+		fp->name[n] = name[n] & 0x7F;
+
+	fp->dent = vol->drm;	// Search from directory entry 0
+	fp->wr = 0;
+
+	return cpm_extent(fp, 0);
+}
+
+FRESULT cpm_create(CPMFIL * fp, CPMVOL * vol, const BYTE * name)
+{
+	FRESULT fr;
+	BYTE n;
+
+	fp->vol = vol;
+
+	for (n = 0; n < 11; n++)
+		fp->name[n] = name[n] & 0x7F;
+
+	fr = cpm_unlink(vol, fp->name);
+	if ((fr != FR_OK) && (fr != FR_NO_FILE))
+		return fr;
+
+	if (!vol->alvok)
+	{
+		fr = cpm_alvinit(vol);
+		if (fr != FR_OK)
+			return fr;
+	}
+
+	// Directory entry is claimed when the first extent is stored
+	fp->dent = NODENT;
+	fp->ext = 0;
+	fp->rec = 0;
+	fp->nrec = 0;
+	fp->last = 0;
+	fp->wr = 1;
+	memset(fp->map, 0, sizeof(fp->map));
+
+	return FR_OK;
+}
+
+FRESULT cpm_close(CPMFIL * fp)
+{
+	FRESULT fr;
+
+	if (!fp->wr)
+		return FR_OK;
+
+	fp->wr = 0;
+
+	fr = cpm_putext(fp);
+	if (fr == FR_OK)
+		fr = cpm_flush(fp->vol);
+
+	return fr;
+}
+
+FRESULT cpm_unlink(CPMVOL * vol, const BYTE * name)
+{
+	BYTE * dent;
+	WORD idx;
+	BYTE found;
+
+	found = 0;
+
+	for (idx = 0; idx <= vol->drm; idx++)
+	{
+		dent = cpm_dirent(vol, idx);
+		if (dent == NULL)
+			return FR_DISK_ERR;
+
+		if (!cpm_match(vol, dent, name))
+			continue;
+
+		if (vol->alvok)
+			cpm_mark(vol, dent, 0);
+
+		dent[0] = 0xE5;
+		vol->wflag = 1;
+		vol->dirty = 1;
+
+		if (idx < vol->dfree)
+			vol->dfree = idx;
+
+		found = 1;
+	}
+
+	if (!found)
+		return FR_NO_FILE;
+
+	return cpm_flush(vol);
+}
+
+FRESULT cpm_read(CPMFIL * fp, BYTE * buf, UINT btr, UINT * br)
+{
+	CPMVOL * vol;
+	FRESULT fr;
+	WORD full, blm, blk, n, nmax;
+	BYTE i;
+	DWORD sect;
+
+	vol = fp->vol;
+	full = (WORD)(vol->exm + 1) << 7;
+	blm = (1 << vol->bsh) - 1;
+
+	// Whole sectors only, so every transfer lands directly in buf
+	nmax = (btr / CPM_SECSZ) << 2;
+	*br = 0;
+
+	while (nmax > 0)
+	{
+		if (fp->rec >= fp->nrec)
+		{
+			// Only a full entry can be followed by another extent
+			if (fp->nrec < full)
+				break;
+
+			fr = cpm_extent(fp, fp->ext + vol->exm + 1);
+			if (fr == FR_NO_FILE)
+			{
+				fp->rec = fp->nrec = 0;
+				break;
+			}
+			if (fr != FR_OK)
+				return fr;
+			continue;
+		}
+
+		i = fp->rec >> vol->bsh;
+		blk = cpm_block(fp, i);
+
+		// Unallocated block reads as end of file, as with BDOS
+		if (blk == 0)
+		{
+			fp->nrec = fp->rec;
+			break;
+		}
+
+		sect = vol->base + ((DWORD)blk << (vol->bsh - 2)) + ((fp->rec & blm) >> 2);
+
+		// Run to the end of this block, extended over any
+		// physically contiguous blocks that follow
+		n = (blm + 1) - (fp->rec & blm);
+		while ((fp->rec + n < fp->nrec) && (n < nmax) && (cpm_block(fp, ++i) == ++blk))
+			n += blm + 1;
+
+		if (n > fp->nrec - fp->rec)
+			n = fp->nrec - fp->rec;
+		if (n > nmax)
+			n = nmax;
+
+		if (dskread(sect, buf, (n + 3) >> 2, vol->unit))
+			return FR_DISK_ERR;
+
+		fp->rec += n;
+		buf += n << 7;
+		*br += n << 7;
+		nmax -= n;
+	}
+
+	return FR_OK;
+}
+
+FRESULT cpm_write(CPMFIL * fp, const BYTE * buf, UINT btw, UINT * bw)
+{
+	CPMVOL * vol;
+	FRESULT fr;
+	WORD full, blm, blk, r, n, m, nleft;
+	DWORD sect, s;
+
+	vol = fp->vol;
+	full = (WORD)(vol->exm + 1) << 7;
+	blm = (1 << vol->bsh) - 1;
+
+	nleft = btw >> 7;
+	*bw = 0;
+
+	// Sectors are written whole, so only the last write of a file
+	// may end part way through a sector
+	if (nleft && (fp->rec & 3))
+		return FR_INVALID_PARAMETER;
+
+	while (nleft > 0)
+	{
+		if (fp->rec >= full)
+		{
+			// Entry is full, store it and start the next extent
+			fr = cpm_putext(fp);
+			if (fr != FR_OK)
+				return fr;
+
+			fp->dent = NODENT;
+			fp->ext += vol->exm + 1;
+			fp->rec = 0;
+			memset(fp->map, 0, sizeof(fp->map));
+		}
+
+		// Gather the records that land in consecutive sectors,
+		// allocating blocks next to the previous one when free
+		for (n = 0; n < nleft; n += m)
+		{
+			r = fp->rec + n;
+			if (r >= full)
+				break;
+
+			blk = cpm_block(fp, r >> vol->bsh);
+			if (blk == 0)
+			{
+				blk = cpm_alloc(vol, fp->last + 1);
+				if (blk == 0)
+					break;
+				cpm_setblock(fp, r >> vol->bsh, blk);
+				fp->last = blk;
+			}
+
+			s = vol->base + ((DWORD)blk << (vol->bsh - 2)) + ((r & blm) >> 2);
+			if (n == 0)
+				sect = s;
+			else if (s != sect + (n >> 2))
+				break;
+
+			m = (blm + 1) - (r & blm);
+			if (m > nleft - n)
+				m = nleft - n;
+		}
+
+		if (n == 0)
+			return FR_DENIED;		// Disk full
+
+		if (dskwrite(sect, buf, (n + 3) >> 2, vol->unit))
+			return FR_DISK_ERR;
+
+		vol->dirty = 1;
+		fp->rec += n;
+		buf += n << 7;
+		*bw += n << 7;
+		nleft -= n;
+	}
+
+	return FR_OK;
+}
@@ -0,0 +1,54 @@
+#ifndef _CPMDSK_H
+#define _CPMDSK_H
+
+#include "ff.h"
+
+// Direct access to a CP/M filesystem in a RomWBW hard disk slice
+// using HBIOS sector I/O (bypasses BDOS record deblocking)
+
+#define CPM_SECSZ 512		// HBIOS hard disk sector size
+#define CPM_RECSZ 128		// CP/M record size
+#define CPM_MAXBLK 2048		// Most blocks in a slice (8MB of 4K blocks)
+
+typedef struct {
+	BYTE drv;			// CP/M drive (0=A)
+	BYTE unit;			// HBIOS disk unit
+	BYTE user;			// CP/M user area
+	BYTE bsh;			// Block shift (records)
+	BYTE exm;			// Extent mask
+	BYTE wide;			// Block pointers are 16 bits
+	BYTE dirty;			// Volume modified, BDOS must relog
+	BYTE wflag;			// win[] modified
+	BYTE alvok;			// alv[] built
+	WORD dsm;			// Highest block number
+	WORD drm;			// Highest directory entry number
+	WORD al;			// Directory blocks (AL0/AL1)
+	WORD dfree;			// Lowest directory entry that may be free
+	DWORD base;			// Sector of block 0 (start of directory)
+	DWORD winsect;		// Directory sector held in win[]
+	BYTE win[CPM_SECSZ];	// Directory sector window
+	BYTE alv[CPM_MAXBLK / 8];	// Block allocation bitmap (writing only)
+} CPMVOL;
+
+typedef struct {
+	CPMVOL * vol;		// Owning volume
+	BYTE name[11];		// File name and type (attributes stripped)
+	WORD ext;			// First logical extent of current entry
+	WORD dent;			// Directory index of current entry
+	WORD rec;			// Records consumed in current entry
+	WORD nrec;			// Records held by current entry
+	WORD last;			// Last block allocated (writing)
+	BYTE wr;			// Opened for writing
+	BYTE map[16];		// Block pointers of current entry
+} CPMFIL;
+
+FRESULT cpm_mount(CPMVOL * vol, BYTE drv);
+FRESULT cpm_unmount(CPMVOL * vol);
+FRESULT cpm_open(CPMFIL * fp, CPMVOL * vol, const BYTE * name);
+FRESULT cpm_create(CPMFIL * fp, CPMVOL * vol, const BYTE * name);
+FRESULT cpm_read(CPMFIL * fp, BYTE * buf, UINT btr, UINT * br);
+FRESULT cpm_write(CPMFIL * fp, const BYTE * buf, UINT btw, UINT * bw);
+FRESULT cpm_close(CPMFIL * fp);
+FRESULT cpm_unlink(CPMVOL * vol, const BYTE * name);
+
+#endif /* _CPMDSK_H */
@@ -90,31 +90,10 @@ DRESULT disk_read (
 	UINT count		/* Number of sectors to read */
 )
 {
-	REGS reg;
-	
 	//printf("\ndisk_read(%u, %lu, %u)", pdrv, sector, count);
 	
-	reg.b.B = 0x12;		// HBIOS Seek
-	reg.b.C = pdrv;
-	reg.w.DE = (WORD)(sector>>16);
-	reg.w.HL = (WORD)sector;
-	reg.b.D |= 0x80;		// High bit signifies LBA address
-	bioscall(&reg, &reg);
-	
-	//printf("\nHBIOS Seek = %u", reg.b.A);
-
-	if (reg.b.A == 0)
-	{
-		reg.b.B = 0x13;		// HBIOS Read
-		reg.b.C = pdrv;
-		reg.w.DE = count;
-		reg.w.HL = (WORD)buff;
-		bioscall(&reg, &reg);
-		
-		//printf("\nHBIOS Read = %u", reg.b.A);
-	}
-
-	return reg.b.A ? RES_ERROR : RES_OK;
+	// HBIOS Seek + Read in a single call
+	return dskread(sector, buff, count, pdrv) ? RES_ERROR : RES_OK;
 }
 
 
@@ -130,31 +109,10 @@ DRESULT disk_write (
 	UINT count			/* Number of sectors to write */
 )
 {
-	REGS reg;
-	
 	//printf("\ndisk_write(%uc, %ul, %u)", pdrv, sector, count);
 
-	reg.b.B = 0x12;		// HBIOS Seek
-	reg.b.C = pdrv;
-	reg.w.DE = (WORD)(sector>>16);
-	reg.w.HL = (WORD)sector;
-	reg.b.D |= 0x80;		// High bit signifies LBA address
-	bioscall(&reg, &reg);
-	
-	//printf("\nHBIOS Seek = %u", reg.b.A);
-
-	if (reg.b.A == 0)
-	{
-		reg.b.B = 0x14;		// HBIOS Read
-		reg.b.C = pdrv;
-		reg.w.DE = count;
-		reg.w.HL = (WORD)buff;
-		bioscall(&reg, &reg);
-		
-		//printf("\nHBIOS Write = %u", reg.b.A);
-	}
-
-	return reg.b.A ? RES_ERROR : RES_OK;
+	// HBIOS Seek + Write in a single call
+	return dskwrite(sector, buff, count, pdrv) ? RES_ERROR : RES_OK;
 }
 
 
@@ -18,6 +18,8 @@ LICENSE:
 #include "bios.h"
 #include "bdos.h"
 #include "ff.h"
+#include "cpmdsk.h"
+#include "char_cpm.h"
 
 #define MAX_FN 12
 #define MAX_PATH 255
@@ -28,10 +30,33 @@ LICENSE:
 #define FS_UNK 0
 #define FS_FAT 1
 #define FS_CPM 2
+#define FS_CPMD 3		// CP/M via direct disk access (cpmdsk.c)
 
 #define RECLEN 128
 
-#define CHUNKSIZE 32
+#define CPMFNLEN 11		// CP/M filename + extension (no dot)
+
+#define STACK_RESERVE 4096	// Stack space kept free below TpaTop() caller
+
+#define XFER_MIN 2048		// TPA kept for copy buffer when listing files
+#define XFER_MAX 16384		// Largest copy buffer used
+
+#define OVL_FMT "FATFMT.OVL"	// FORMAT overlay with f_mkfs() (see Build.cmd)
+
+#define DIR_PAGE 20			// DIR /P lines per screen
+#define DIR_STOP 100		// DIR stopped at /P prompt (not an error)
+
+#define OPT_DIRECT 0x0001	// /D: direct CP/M disk access via HBIOS
+#define OPT_SORTN 0x0002	// /ON: DIR sorted by name
+#define OPT_SORTS 0x0004	// /OS: DIR sorted by size
+#define OPT_SORTD 0x0008	// /OD: DIR sorted by date and time
+#define OPT_PAGE 0x0010		// /P: DIR pauses after each screen
+#define OPT_SUBDIR 0x0020	// /S: DIR or COPY includes all sub-directories
+#define OPT_UPDATE 0x0040	// /U: COPY only new or changed files
+#define OPT_DELTA 0x0080	// /C: COPY rewrites only changed sectors of a FAT file
+#define OPT_VERIFY 0x0100	// /V: COPY reads back and checks each file written
+#define OPT_SORT (OPT_SORTN | OPT_SORTS | OPT_SORTD)
+#define OPT_BAD 0x8000		// Unrecognized option switch
 
 typedef struct
 {
@@ -40,9 +65,50 @@ typedef struct
 	{
 		FCB	fcb;
 		FIL fil;
+		CPMFIL cfil;
 	};
 } FILE;
 
+typedef struct
+{
+	char	name[CPMFNLEN];		// Name and extension, space padded
+	DWORD	fsize;
+	WORD	fdate;
+	WORD	ftime;
+	BYTE	fattrib;
+} DIRREC;		// Directory entry kept for sorted DIR or COPY /U
+
+typedef struct
+{
+	DWORD	sclust;		// Start cluster of parent directory
+	DWORD	ofs;		// Offset of next entry to read in parent
+	UINT	nPath;		// Length of parent path shown
+	DWORD	dclust;		// Start cluster of destination parent (COPY /S)
+	UINT	nDest;		// Length of destination parent path (COPY /S)
+} DIRFRAME;		// Parent of a directory being walked by DIR /S or COPY /S
+
+extern BYTE heap_start[];	// First free TPA byte above program (see ucrt0.s)
+extern WORD getsp(void);	// Current stack pointer (see ucrt0.s)
+
+WORD wOpts;			// Option switches from command line
+BYTE * pTpaFree;	// First unused byte of free TPA
+CPMVOL * pCpmVol;	// CP/M volume for direct access (/D)
+char * szShowPath;	// Directory shown with file names by ShowXxx()
+FATFS * pFatFs[FF_VOLUMES];	// FAT volumes mounted for the run
+int bScript;		// Script file is being run
+BYTE * pOvlMark;	// Free TPA before the overlay was loaded (NULL: none loaded)
+UINT nOvlSave;		// Bytes from heap_start saved above the overlay (0: none)
+UINT nDirFiles;		// Files listed by DIR
+UINT nDirDirs;		// Sub-directories listed by DIR
+DWORD dwDirBytes;	// Size of files listed by DIR
+UINT nDirLines;		// DIR lines on this /P screen
+int bDirCont;		// Next DIR line goes on the cleared /P prompt line
+int nCopied;		// Files copied by COPY from FAT
+int nSame;			// Files left alone by COPY /U
+DIRREC * pSyncIdx;	// COPY /U destination entries, sorted by name
+UINT nSyncIdx;		// Entries in pSyncIdx
+int bSyncPart;		// pSyncIdx holds only part of the destination
+
 int bios_id;
 
 char * ErrTab[] =
@@ -76,6 +142,12 @@ char * BiosName[] =
 	"UNA UBIOS"
 };
 
+DWORD DecTab[] =		// Powers of ten for PutDec()
+{
+	1000000000, 100000000, 10000000, 1000000, 100000,
+	10000, 1000, 100, 10, 1
+};
+
 char * strupr(char * str)
 {
 	char * s;
@@ -86,6 +158,116 @@ char * strupr(char * str)
 	return str;
 }
 
+BYTE * TpaTop(void)
+{
+	// Free TPA extends from heap_start up to the stack, less
+	// room for the stack to grow in the callers that follow
+	return (BYTE *)(getsp() - STACK_RESERVE);
+}
+
+UINT TpaAvail(void)
+{
+	BYTE * pTop;
+	
+	pTop = TpaTop();
+	
+	return (pTop > pTpaFree) ? (UINT)(pTop - pTpaFree) : 0;
+}
+
+void * TpaAlloc(UINT n)
+{
+	BYTE * p;
+	
+	// Free TPA is used as an arena: blocks are taken from the
+	// bottom and given back (with all later ones) by TpaRelease()
+	if (n > TpaAvail())
+		return NULL;
+	
+	p = pTpaFree;
+	pTpaFree += n;
+	
+	return p;
+}
+
+void TpaRelease(void * p)
+{
+	pTpaFree = (BYTE *)p;
+}
+
+UINT XferSize(void)
+{
+	UINT n;
+	
+	// Copy buffer is the unused TPA, in whole disk sectors
+	n = TpaAvail();
+	if (n > XFER_MAX)
+		n = XFER_MAX;
+	
+	return n & ~(CPM_SECSZ - 1);
+}
+
+char * NextParm(void)
+{
+	char * tok;
+	
+	// Return next positional parameter, picking up any
+	// option switches (/x) along the way
+	while (((tok = strtok(NULL, " ")) != NULL) && (*tok == '/'))
+	{
+		switch (toupper(tok[1]))
+		{
+			case 'C':
+				wOpts |= OPT_DELTA;
+				break;
+			
+			case 'D':
+				wOpts |= OPT_DIRECT;
+				break;
+			
+			case 'O':
+				switch (toupper(tok[2]))
+				{
+					case 'N':
+						wOpts |= OPT_SORTN;
+						break;
+					
+					case 'S':
+						wOpts |= OPT_SORTS;
+						break;
+					
+					case 'D':
+						wOpts |= OPT_SORTD;
+						break;
+					
+					default:
+						wOpts |= OPT_BAD;
+				}
+				break;
+			
+			case 'P':
+				wOpts |= OPT_PAGE;
+				break;
+			
+			case 'S':
+				wOpts |= OPT_SUBDIR;
+				break;
+			
+			case 'U':
+				wOpts |= OPT_UPDATE;
+				break;
+			
+			case 'V':
+				wOpts |= OPT_VERIFY;
+				break;
+			
+			default:
+				wOpts |= OPT_BAD;
+		}
+	}
+	
+	return tok;
+}
+
 int Confirm(void)
 {
 	char c;
@@ -111,15 +293,26 @@ int Usage(void)
 		"\nCopyright (C) 2019-24, Wayne Warthen, GNU GPL v3"
 		"\n"
 		"\nUsage: FAT <cmd> <parms>"
-		"\n  FAT DIR <path>"
-		"\n  FAT COPY <src> <dst>"
+		"\n  FAT DIR [/ON|/OS|/OD] [/P] [/S] <path>"
+		"\n  FAT COPY [/D] [/S] [/U] [/C] [/V] <src> <dst>"
+		"\n  FAT SUM <path>"
 		"\n  FAT REN <from> <to>"
 		"\n  FAT DEL <path>[<file>|<dir>]"
 		"\n  FAT MD <path>"
 		"\n  FAT FORMAT <drv>"
+		"\n  FAT <cmd> <parms>;<cmd> <parms>..."
+		"\n  FAT @<file>"
 		"\n"
 		"\nCP/M filespec: <d>:FILENAME.EXT (<d> is CP/M drive letter A-P)"
 		"\nFAT filespec:  <u>:/DIR/FILENAME.EXT (<u> is disk unit #)"
+		"\n"
+		"\n/D  Direct CP/M disk access (COPY to/from RomWBW slice only)"
+		"\n/ON, /OS, /OD  Sort DIR by name, size or date"
+		"\n/P  Pause DIR after each screen"
+		"\n/S  DIR or COPY all sub-directories too"
+		"\n/U  COPY only new or changed files"
+		"\n/C  COPY rewrites only changed parts of FAT files"
+		"\n/V  COPY reads back and checks each file written"
 		"\n",
 		BiosName[bios_id]
 	);
@@ -157,6 +350,18 @@ FRESULT SplitPath(char * szPath, char * szFileSpec)
 	return FR_OK;
 }
 
+const TCHAR * FileName(const TCHAR * szPath)
+{
+	const TCHAR * p;
+	
+	// Name follows the terminal separator
+	p = szPath + strlen(szPath);
+	while ((p > szPath) && (p[-1] != '/') && (p[-1] != '\\') && (p[-1] != ':'))
+		p--;
+	
+	return p;
+}
+
 int IsWild(char * szPath)
 {
 	char * p;
@@ -214,6 +419,49 @@ int FatDrive(char * szPath)
 	return atoi(szDrive);
 }
 
+FRESULT Mount(char * szPath, BYTE opt)
+{
+	int vol;
+	DIR dir;
+	char szDrive[4];
+	
+	vol = FatDrive(szPath);
+	if ((vol < 0) || (vol >= FF_VOLUMES))
+		return FR_INVALID_DRIVE;
+	
+	// A volume is mounted once per run, so the commands of
+	// a batch share its filesystem object and sector window
+	if (pFatFs[vol] == NULL)
+	{
+		pFatFs[vol] = (FATFS *)TpaAlloc(sizeof(FATFS));
+		if (pFatFs[vol] == NULL)
+			return FR_NOT_ENOUGH_CORE;
+		
+		return f_mount(pFatFs[vol], szPath, opt);
+	}
+	
+	if (!opt)
+		return FR_OK;
+	
+	// Already mounted, just check the volume is still valid
+	sprintf(szDrive, "%i:", vol);
+	
+	return f_opendir(&dir, szDrive);
+}
+
+int CpmDrive(char * szPath)
+{
+	// CP/M drive number (0=A) of path, default is current drive
+	if (szPath[0] && (szPath[1] == ':'))
+	{
+		if ((szPath[0] >= 'A') && (szPath[0] <= 'P'))
+			return szPath[0] - 'A';
+		return -1;
+	}
+	
+	return BDOS_GETDISK();
+}
+
 int IsValidFilenameChar(char c)
 {
 	//char sBadCharList[] = "<>.,;:=?*[]_%|()/\\";
@@ -330,6 +578,13 @@ int Exists(const TCHAR * path)
 		return FALSE;
 	
 	// DumpFCB(&fcb);
+	
+	if (pCpmVol)
+	{
+		CPMFIL cfil;
+		
+		return (cpm_open(&cfil, pCpmVol, fcb.name) == FR_OK);
+	}
 		
 	BDOS_SETDMA((WORD)&buf);
 	
@@ -348,19 +603,41 @@ FRESULT DeleteFile(const TCHAR * path)
 	
 	fr = MakeFCB(path, &fcb);
 	
+	if (pCpmVol)
+		return (fr == FR_OK) ? cpm_unlink(pCpmVol, fcb.name) : fr;
+	
 	BDOS_DELETE((WORD)&fcb);	// DELETE function has no return value
 
 	return FR_OK;
 }
 
-FRESULT Open(FILE * pfile, const TCHAR * path, BYTE mode)
+FRESULT Open(FILE * pfile, const DIR * pdir, const TCHAR * path, BYTE mode)
 {
+	// With the directory already open, FAT files are looked up
+	// by name in that directory instead of by the full path
 	if (pfile->fstyp == FS_FAT)
-		return f_open(&pfile->fil, path, mode);
+		return f_openat(&pfile->fil, pdir, pdir ? FileName(path) : path, mode);
 	
 	BYTE rc;
 	FRESULT fr;
 	
+	if (pfile->fstyp == FS_CPMD)
+	{
+		FCB fcb;
+		
+		fr = MakeFCB(path, &fcb);
+		if (fr != FR_OK)
+			return fr;
+		
+		if (mode & FA_READ)
+			return cpm_open(&pfile->cfil, pCpmVol, fcb.name);
+		
+		if (mode & FA_WRITE)
+			return cpm_create(&pfile->cfil, pCpmVol, fcb.name);
+		
+		return FR_INVALID_PARAMETER;
+	}
+	
 	fr = MakeFCB(path, &pfile->fcb);
 	
 	if (fr != FR_OK)
@@ -390,7 +667,10 @@ FRESULT Open(FILE * pfile, const TCHAR * path, BYTE mode)
 FRESULT Close(FILE * pfile)
 {
 	if (pfile->fstyp == FS_FAT)
-		f_close(&pfile->fil);
+		return f_close(&pfile->fil);
+
+	if (pfile->fstyp == FS_CPMD)
+		return cpm_close(&pfile->cfil);
 
 	BYTE rc;
 	
@@ -406,225 +686,1487 @@ FRESULT Close(FILE * pfile)
 
 FRESULT Read(FILE * pfile, void * pbuf, UINT btr, UINT * br)
 {
-	if (btr != RECLEN)
+	if (btr % RECLEN)
 		return FR_INVALID_PARAMETER;
 	
 	if (pfile->fstyp == FS_FAT)
-		return f_read(&pfile->fil, pbuf, RECLEN, br);
+		return f_read(&pfile->fil, pbuf, btr, br);
+
+	if (pfile->fstyp == FS_CPMD)
+		return cpm_read(&pfile->cfil, pbuf, btr, br);
 
 	BYTE rc;
 
-	BDOS_SETDMA((WORD)pbuf);
-	
-	rc = BDOS_READSEQ((WORD)&pfile->fcb);
-	
-	//printf("\nBDOS ReadSeq(): %i", rc);
+	for (*br = 0; *br < btr; *br += RECLEN)
+	{
+		BDOS_SETDMA((WORD)pbuf + *br);
+		
+		rc = BDOS_READSEQ((WORD)&pfile->fcb);
+		
+		//printf("\nBDOS ReadSeq(): %i", rc);
 
-	// Non-zero return indicates EOF	
-	if (rc == 0)
-		*br = RECLEN;
-	else
-		*br = 0;
+		// Non-zero return indicates EOF	
+		if (rc != 0)
+			break;
+	}
 
 	return FR_OK;
 }
 
 FRESULT Write(FILE * pfile, void * pbuf, UINT btw, UINT * bw)
 {
-	if (btw != RECLEN)
+	if (btw % RECLEN)
 		return FR_INVALID_PARAMETER;
 	
 	if (pfile->fstyp == FS_FAT)
-		return f_write(&pfile->fil, pbuf, RECLEN, bw);
+		return f_write(&pfile->fil, pbuf, btw, bw);
 
-	BYTE rc;
+	if (pfile->fstyp == FS_CPMD)
+		return cpm_write(&pfile->cfil, pbuf, btw, bw);
 
-	BDOS_SETDMA((WORD)pbuf);
-	
-	rc = BDOS_WRITESEQ((WORD)&pfile->fcb);
-	
-	// printf("\nBDOS WriteSeq(): %i", rc);
-	
-	if (rc != 0)
-		return FR_DISK_ERR; // Actually "out of space"
+	BYTE rc;
 
-	*bw = RECLEN;
+	for (*bw = 0; *bw < btw; *bw += RECLEN)
+	{
+		BDOS_SETDMA((WORD)pbuf + *bw);
+		
+		rc = BDOS_WRITESEQ((WORD)&pfile->fcb);
+		
+		// printf("\nBDOS WriteSeq(): %i", rc);
+		
+		if (rc != 0)
+			return FR_DISK_ERR; // Actually "out of space"
+	}
 
 	return FR_OK;
 }
 
-void DirLine(FILINFO *pfno)
-{
-	printf("\n%02u/%02u/%04u  ",
-		((pfno->fdate >> 5) & 0x0F),
-		((pfno->fdate >> 0) & 0x1F),
-		(((pfno->fdate >> 9) & 0x7F) + 1980)
-		);
-
-	printf("%02u:%02u:%02u  ",
-		((pfno->ftime >> 11) & 0x1F),
-		((pfno->ftime >> 5) & 0x3F),
-		(((pfno->ftime >> 0) & 0x1F) << 1)
-		);
-		
-	// Print attributes???
-
-    if (pfno->fattrib & AM_DIR)                    /* It is a directory */
-		printf("  <dir>       ");
-	else
-		printf("%12lu  ", pfno->fsize);
-	
-	printf("%c%c%c%c  ",
-	       (pfno->fattrib & AM_RDO) ? 'R' : '-',
-	       (pfno->fattrib & AM_HID) ? 'H' : '-',
-	       (pfno->fattrib & AM_SYS) ? 'S' : '-',
-	       (pfno->fattrib & AM_ARC) ? 'A' : '-');
-	
-    printf("%s", pfno->fname);
-}
+#if FF_MKFS_OVL
+typedef FRESULT (*MKFSFUNC)(const TCHAR *, const MKFS_PARM *, void *, UINT);
 
-FRESULT Dir(void)
+FRESULT OvlLoad(char * szFile)
 {
-	FATFS fs;
 	FRESULT fr;
-	DIR dir;
-	FILINFO fno;
-	char * szPath;
-	char szFileSpec[MAX_FN];
+	FILE file;
+	char szPath[MAX_FN + 3];
+	BYTE * pBuf;
+	UINT n, br;
+	
+	// Overlays are linked to run at heap_start.  When free TPA
+	// starts there the overlay is just read in.  Otherwise it is
+	// read into free TPA and swapped with the bytes at heap_start,
+	// which OvlUnload() puts back, so nothing has to be loaded
+	// ahead of the command that needs it.
+	if (pOvlMark)
+		return FR_INT_ERR;
+	
+	// Overlay is looked for on the current drive, then on A:
+	file.fstyp = FS_CPM;
+	fr = Open(&file, NULL, szFile, FA_READ);
+	if (fr == FR_NO_FILE)
+	{
+		sprintf(szPath, "A:%s", szFile);
+		fr = Open(&file, NULL, szPath, FA_READ);
+	}
+	if (fr != FR_OK)
+		return fr;
+	
+	// Swapping needs the same room again to save the bytes
+	pBuf = pTpaFree;
+	n = TpaAvail();
+	if (pBuf != heap_start)
+		n /= 2;
+	n &= ~(RECLEN - 1);
+	br = 0;
+	fr = Read(&file, pBuf, n, &br);
+	Close(&file);
+	
+	if ((fr == FR_OK) && (br >= n))
+		fr = FR_NOT_ENOUGH_CORE;
+	
+	// Overlay starts with a jump to its entry, followed by
+	// the heap_start of the FAT.COM it was linked with
+	if ((fr == FR_OK) && ((br < 5) || (pBuf[0] != 0xC3) ||
+		(*(WORD *)(pBuf + 3) != (WORD)heap_start)))
+		fr = FR_INVALID_OBJECT;
 	
-	szPath = strtok(NULL, " ");
-	if (szPath == NULL)
-		return FR_INVALID_PARAMETER;
-
-	fr = f_mount(&fs, szPath, 0);
 	if (fr != FR_OK)
 		return fr;
 	
-	fr = f_stat(szPath, &fno);
-
-	if ((fr == FR_OK) && (fno.fattrib & AM_DIR))
-		*szFileSpec = '\0';
-	else
-		fr = SplitPath(szPath, szFileSpec);
+	pOvlMark = pBuf;
+	nOvlSave = 0;
+	if (pBuf != heap_start)
+	{
+		nOvlSave = br;
+		memcpy(pBuf + br, heap_start, br);
+		memmove(heap_start, pBuf, br);
+		br *= 2;
+	}
+	TpaAlloc(br);
+	
+	return FR_OK;
+}
 
-	if (*szFileSpec == '\0')
-		strcpy(szFileSpec, "*");
+void OvlUnload(void)
+{
+	// Put back the bytes the overlay was swapped with and
+	// give its memory back to free TPA
+	if (pOvlMark == NULL)
+		return;
 	
-	// printf("\nf_findfirst() szPath: '%s', szFileSpec: '%s'", szPath, szFileSpec);
+	if (nOvlSave)
+		memcpy(heap_start, pOvlMark + nOvlSave, nOvlSave);
+	
+	TpaRelease(pOvlMark);
+	pOvlMark = NULL;
+}
+#endif
 
-	if (fr == FR_OK)
-		fr = f_findfirst(&dir, &fno, szPath, szFileSpec);
+// Put the last nDig (1-10) decimal digits of n at psz, with leading
+// zeros.  Each digit is counted out by subtracting its power of ten
+// from DecTab[], which is much cheaper than 32-bit division on Z80.
+char * PutDec(char * psz, DWORD n, BYTE nDig)
+{
+	DWORD * pdw;
+	char c;
+	
+	for (pdw = &DecTab[10 - nDig]; nDig; nDig--, pdw++)
+	{
+		for (c = '0'; n >= *pdw; c++)
+			n -= *pdw;
+		*psz++ = c;
+	}
+	
+	return psz;
+}
 
-	if (fr == FR_OK)
-		printf("\nDirectory of %s\n", szPath);
+void PutStr(const char * psz)
+{
+	while (*psz)
+		putchar(*psz++);
+}
 
-	while ((fr == FR_OK) && (fno.fname[0]))
+// The fixed width part of the line is built without printf():
+// "\nMM/DD/YYYY  HH:MM:SS  <size|dir>  RHSA  "
+void DirLine(FILINFO *pfno)
+{
+	char szLine[44];
+	char * p;
+	char * q;
+	
+	p = szLine;
+	*p++ = '\n';
+	
+	p = PutDec(p, (pfno->fdate >> 5) & 0x0F, 2);
+	*p++ = '/';
+	p = PutDec(p, pfno->fdate & 0x1F, 2);
+	*p++ = '/';
+	p = PutDec(p, ((pfno->fdate >> 9) & 0x7F) + 1980, 4);
+	*p++ = ' ';
+	*p++ = ' ';
+	
+	p = PutDec(p, (pfno->ftime >> 11) & 0x1F, 2);
+	*p++ = ':';
+	p = PutDec(p, (pfno->ftime >> 5) & 0x3F, 2);
+	*p++ = ':';
+	p = PutDec(p, (pfno->ftime & 0x1F) << 1, 2);
+	*p++ = ' ';
+	*p++ = ' ';
+	
+	if (pfno->fattrib & AM_DIR)
 	{
-		DirLine(&fno);
-		fr = f_findnext(&dir, &fno);
+		memcpy(p, "  <dir>       ", 14);
+		p += 14;
+	}
+	else
+	{
+		*p++ = ' ';
+		*p++ = ' ';
+		q = p;
+		p = PutDec(p, pfno->fsize, 10);
+		while ((q < p - 1) && (*q == '0'))		// right align
+			*q++ = ' ';
+		*p++ = ' ';
+		*p++ = ' ';
 	}
+	
+	*p++ = (pfno->fattrib & AM_RDO) ? 'R' : '-';
+	*p++ = (pfno->fattrib & AM_HID) ? 'H' : '-';
+	*p++ = (pfno->fattrib & AM_SYS) ? 'S' : '-';
+	*p++ = (pfno->fattrib & AM_ARC) ? 'A' : '-';
+	*p++ = ' ';
+	*p++ = ' ';
+	*p = '\0';
+	
+	PutStr(bDirCont ? szLine + 1 : szLine);
+	PutStr(pfno->fname);
+	bDirCont = FALSE;
+}
 
-	f_mount(0, szPath, 0);		// unmount ignoring any errors
+int DirPage(void)
+{
+	char c;
 	
-	return fr;
+	// Count a line for DIR /P, wait for a key when the screen is
+	// full.  Returns FALSE if the listing is to be stopped.
+	if (!(wOpts & OPT_PAGE) || (++nDirLines < DIR_PAGE))
+		return TRUE;
+	
+	printf("\n-- More --");
+	c = getchar();
+	PutStr("\r          \r");
+	nDirLines = 0;
+	bDirCont = TRUE;
+	
+	return (c != 3) && (c != 27) && (toupper(c) != 'Q');
 }
 
-FRESULT CopyFile(char * szSrcFile, char * szDestFile)
+FRESULT DirEntry(FILINFO * pfno)
 {
-	FRESULT fr;
-	FILE fileSrc, fileDest;
+	if (!DirPage())
+		return DIR_STOP;
 	
-	//printf("\n  CopyFile() %s ==> %s", szSrcFile, szDestFile);
-	printf("\n%s ==> %s", szSrcFile, szDestFile);
+	DirLine(pfno);
 	
-	if (strcmp(szSrcFile, szDestFile) == 0)
-		return FR_INVALID_PARAMETER;
+	if (pfno->fattrib & AM_DIR)
+		nDirDirs++;
+	else
+	{
+		nDirFiles++;
+		dwDirBytes += pfno->fsize;
+	}
 	
-	memset(&fileSrc, 0, sizeof(fileSrc));
-	memset(&fileDest, 0, sizeof(fileDest));
+	return FR_OK;
+}
+
+void RecName(char * pName, const char * szName)
+{
+	const char * p;
+	const char * pExt;
+	BYTE i;
+	
+	// Name and extension, space padded like a CP/M directory entry
+	memset(pName, ' ', CPMFNLEN);
+	
+	pExt = strrchr(szName, '.');
+	if ((pExt == szName) || ((pExt != NULL) && (pExt[1] == '\0')))
+		pExt = NULL;		// "." and ".." have no extension
+	
+	for (p = szName, i = 0; *p && (p != pExt) && (i < 8); )
+		pName[i++] = toupper(*p++);
+	if (pExt != NULL)
+		for (p = pExt + 1, i = 8; *p && (i < CPMFNLEN); )
+			pName[i++] = toupper(*p++);
+}
+
+void DirRec(DIRREC * prec, const FILINFO * pfno)
+{
+	RecName(prec->name, pfno->fname);
 	
-	fileSrc.fstyp = IsFatPath(szSrcFile) ? FS_FAT : FS_CPM;
-	fileDest.fstyp = IsFatPath(szDestFile) ? FS_FAT : FS_CPM;
+	prec->fsize = pfno->fsize;
+	prec->fdate = pfno->fdate;
+	prec->ftime = pfno->ftime;
+	prec->fattrib = pfno->fattrib;
+}
 
-	//printf("\nSrcFile %s FAT", fileSrc.fstyp == FS_FAT ? "IS" : "NOT");
-	//printf("\nDestFile %s FAT", fileDest.fstyp == FS_FAT ? "IS" : "NOT");
+void DirUnrec(FILINFO * pfno, const DIRREC * prec)
+{
+	char * p;
+	BYTE i;
 	
-	if (Exists(szDestFile))
+	p = pfno->fname;
+	for (i = 0; (i < 8) && (prec->name[i] != ' '); i++)
+		*p++ = prec->name[i];
+	if (prec->name[8] != ' ')
 	{
-		printf(" Overwrite? (Y/N)");
-		
-		if (!Confirm())
-			return 100;	// special case value to indicate "skip file"
-		
-		fr = DeleteFile(szDestFile);
-		
-		if (fr != FR_OK)
-			return fr;
+		*p++ = '.';
+		for (i = 8; (i < CPMFNLEN) && (prec->name[i] != ' '); i++)
+			*p++ = prec->name[i];
+	}
+	*p = '\0';
+	
+	pfno->fsize = prec->fsize;
+	pfno->fdate = prec->fdate;
+	pfno->ftime = prec->ftime;
+	pfno->fattrib = prec->fattrib;
+}
+
+int DirCmp(const DIRREC * prec1, const DIRREC * prec2)
+{
+	// Order by the selected key, then by name (unique in a
+	// directory) so that no two entries compare equal
+	if (wOpts & OPT_SORTS)
+	{
+		if (prec1->fsize != prec2->fsize)
+			return (prec1->fsize < prec2->fsize) ? -1 : 1;
+	}
+	else if (wOpts & OPT_SORTD)
+	{
+		if (prec1->fdate != prec2->fdate)
+			return (prec1->fdate < prec2->fdate) ? -1 : 1;
+		if (prec1->ftime != prec2->ftime)
+			return (prec1->ftime < prec2->ftime) ? -1 : 1;
 	}
 	
-	fr = Open(&fileSrc, szSrcFile, FA_READ);
+	return memcmp(prec1->name, prec2->name, CPMFNLEN);
+}
+
+void DirSort(DIRREC * pRec, UINT n)
+{
+	DIRREC rec;
+	UINT nGap, i, j;
+	
+	// Shell sort: in place, no recursion and far fewer moves of
+	// the records than a plain insertion sort
+	for (nGap = 1; nGap < n / 3; nGap = (nGap * 3) + 1)
+		;
 	
-	if (fr == FR_OK)
+	for (; nGap > 0; nGap /= 3)
+	{
+		for (i = nGap; i < n; i++)
+		{
+			rec = pRec[i];
+			for (j = i; (j >= nGap) && (DirCmp(&rec, &pRec[j - nGap]) < 0); j -= nGap)
+				pRec[j] = pRec[j - nGap];
+			pRec[j] = rec;
+		}
+	}
+}
+
+FRESULT DirSorted(DIR * pdir)
+{
+	FRESULT fr;
+	FILINFO fno;
+	DIRREC * pRec;
+	DIRREC rec, recLast;
+	UINT nMax, n, i;
+	int bMore, bLast;
+	
+	// Entries are kept as packed records in free TPA and sorted in
+	// place.  If they don't all fit, each pass over the directory
+	// keeps the nMax lowest entries above the last one listed, so
+	// the listing is produced in sorted runs with fixed memory.
+	// Nothing else is allocated meanwhile, so the records are
+	// simply put at the start of free TPA.
+	pRec = (DIRREC *)pTpaFree;
+	nMax = TpaAvail() / sizeof(DIRREC);
+	if (nMax < 2)
+		return FR_NOT_ENOUGH_CORE;
+	
+	bLast = FALSE;
+	do
 	{
-		fr = Open(&fileDest, szDestFile, FA_WRITE | FA_CREATE_ALWAYS);
+		n = 0;
+		bMore = FALSE;
 		
-		if (fr == FR_OK)
+		fr = f_readdir(pdir, NULL);		// Rewind
+		while (fr == FR_OK)
 		{
-			UINT br, bw;
-			BYTE buf[RECLEN];
+			fr = f_findnext(pdir, &fno);
+			if ((fr != FR_OK) || (fno.fname[0] == '\0'))
+				break;
 			
-			printf(" ...");
+			DirRec(&rec, &fno);
 			
-			do
+			if (!bLast || (DirCmp(&rec, &recLast) > 0))
 			{
-				br = 0;
-				memset(buf, 0x1A, RECLEN);
-			
-				fr = Read(&fileSrc, buf, RECLEN, &br);
-				
-				if (fr != FR_OK)
-					break;
-				
-				if (br > 0)
+				if (n < nMax)
 				{
-					bw = 0;
-
-					fr = Write(&fileDest, buf, RECLEN, &bw);
-
+					pRec[n++] = rec;
+					if (n == nMax)
+						DirSort(pRec, n);
+				}
+				else
+				{
+					// Array is full and sorted, keep the lowest
+					bMore = TRUE;
+					if (DirCmp(&rec, &pRec[n - 1]) < 0)
+					{
+						for (i = n - 1; (i > 0) && (DirCmp(&rec, &pRec[i - 1]) < 0); i--)
+							pRec[i] = pRec[i - 1];
+						pRec[i] = rec;
+					}
+				}
+			}
+		}
+		
+		if (n < nMax)
+			DirSort(pRec, n);
+		
+		for (i = 0; (fr == FR_OK) && (i < n); i++)
+		{
+			DirUnrec(&fno, &pRec[i]);
+			fr = DirEntry(&fno);
+		}
+		
+		if (n > 0)
+		{
+			recLast = pRec[n - 1];
+			bLast = TRUE;
+		}
+	}
+	while ((fr == FR_OK) && bMore);
+	
+	return fr;
+}
+
+FRESULT DirList(DIR * pdir, const char * szPath)
+{
+	FRESULT fr;
+	FILINFO fno;
+	
+	// List the entries of the open directory that match its
+	// pattern (set by f_findfirst()), from the start
+	printf("\nDirectory of %s\n", szPath);
+	nDirLines += 2;
+	bDirCont = FALSE;
+	
+	nDirFiles = 0;
+	nDirDirs = 0;
+	dwDirBytes = 0;
+	
+	if (wOpts & OPT_SORT)
+		return DirSorted(pdir);
+	
+	fr = f_readdir(pdir, NULL);		// Rewind
+	while (fr == FR_OK)
+	{
+		fr = f_findnext(pdir, &fno);
+		if ((fr != FR_OK) || (fno.fname[0] == '\0'))
+			break;
+		fr = DirEntry(&fno);
+	}
+	
+	return fr;
+}
+
+void DirTotal(const char * szPath)
+{
+	FATFS * pfs;
+	DWORD nFree;
+	
+	printf("\n\n    %u File(s), %lu Bytes", nDirFiles, dwDirBytes);
+	printf("\n    %u Dir(s)", nDirDirs);
+	
+	// Sectors are 512 bytes, so half a KB each
+	if (f_getfree(szPath, &nFree, &pfs) == FR_OK)
+		printf(", %lu KB Free", (nFree * pfs->csize) / 2);
+}
+
+FRESULT DirTree(DIR * pdir, char * szPath)
+{
+	FRESULT fr;
+	FILINFO fno;
+	DIRFRAME * pStack;
+	DIRFRAME * pFrame;
+	UINT nDepth, nLen;
+	UINT nFiles, nDirs;
+	DWORD dwBytes;
+	int bDone;
+	
+	// The tree is walked depth first without recursion.  Going
+	// into a sub-directory pushes a frame with the place to go on
+	// from in the parent (start cluster and offset) on a stack in
+	// the TPA arena.  The one directory object is moved around by
+	// f_dirat(), so no path is followed again, szPath is only kept
+	// for the "Directory of" lines.
+	pStack = (DIRFRAME *)pTpaFree;
+	nDepth = 0;
+	nFiles = 0;
+	nDirs = 0;
+	dwBytes = 0;
+	bDone = FALSE;
+	
+	do
+	{
+		fr = DirList(pdir, szPath);
+		if (fr != FR_OK)
+			break;
+		
+		printf("\n\n    %u File(s), %lu Bytes\n", nDirFiles, dwDirBytes);
+		nDirLines += 3;
+		nFiles += nDirFiles;
+		nDirs += nDirDirs;
+		dwBytes += dwDirBytes;
+		
+		// Find the next sub-directory to list, going back up to
+		// the parents as they run out of entries
+		fr = f_readdir(pdir, NULL);		// Rewind
+		while (fr == FR_OK)
+		{
+			fr = f_readdir(pdir, &fno);
+			if (fr != FR_OK)
+				break;
+			
+			if (fno.fname[0] == '\0')
+			{
+				if (nDepth == 0)
+				{
+					bDone = TRUE;
+					break;
+				}
+				pFrame = &pStack[--nDepth];
+				szPath[pFrame->nPath] = '\0';
+				fr = f_dirat(pdir, pFrame->sclust, pFrame->ofs);
+				TpaRelease(pFrame);
+				continue;
+			}
+			
+			if (!(fno.fattrib & AM_DIR))
+				continue;
+			
+			nLen = strlen(szPath);
+			if (nLen + strlen(fno.fname) + 1 > MAX_PATH)
+			{
+				fr = FR_INVALID_NAME;
+				break;
+			}
+			
+			// No frame is needed if this was the last entry of the
+			// directory (f_readdir() then leaves no sector to go on
+			// from), the walk goes straight back to the grandparent
+			if (pdir->sect != 0)
+			{
+				pFrame = TpaAlloc(sizeof(DIRFRAME));
+				if (pFrame == NULL)
+				{
+					fr = FR_NOT_ENOUGH_CORE;
+					break;
+				}
+				pFrame->sclust = pdir->obj.sclust;
+				pFrame->ofs = pdir->dptr;
+				pFrame->nPath = nLen;
+				nDepth++;
+			}
+			
+			if ((nLen == 0) || (szPath[nLen - 1] != '/'))
+				strcat(szPath, "/");
+			strcat(szPath, fno.fname);
+			
+			fr = f_dirat(pdir, fno.fclust, 0);
+			break;
+		}
+	}
+	while ((fr == FR_OK) && !bDone);
+	
+	TpaRelease(pStack);
+	
+	if (fr == FR_OK)
+	{
+		printf("\nTotal Files Listed:");
+		nDirFiles = nFiles;
+		nDirDirs = nDirs;
+		dwDirBytes = dwBytes;
+	}
+	
+	return fr;
+}
+
+FRESULT Dir(void)
+{
+	FRESULT fr;
+	DIR dir;
+	FILINFO fno;
+	char * szPath;
+	char szFileSpec[MAX_FN];
+	char szTree[MAX_PATH + 1];
+	
+	szPath = NextParm();
+	if (szPath == NULL)
+		return FR_INVALID_PARAMETER;
+
+	NextParm();		// Pick up any trailing switches
+	
+	if (wOpts & OPT_BAD)
+		return FR_INVALID_PARAMETER;
+
+	fr = Mount(szPath, 0);
+	if (fr != FR_OK)
+		return fr;
+	
+	fr = f_stat(szPath, &fno);
+
+	if ((fr == FR_OK) && (fno.fattrib & AM_DIR))
+		*szFileSpec = '\0';
+	else
+		fr = SplitPath(szPath, szFileSpec);
+
+	if (*szFileSpec == '\0')
+		strcpy(szFileSpec, "*");
+	
+	// printf("\nf_findfirst() szPath: '%s', szFileSpec: '%s'", szPath, szFileSpec);
+
+	if (fr == FR_OK)
+		fr = f_findfirst(&dir, &fno, szPath, szFileSpec);
+
+	if (fr != FR_OK)
+		return fr;
+	
+	nDirLines = 0;
+	
+	if (wOpts & OPT_SUBDIR)
+	{
+		strcpy(szTree, szPath);
+		fr = DirTree(&dir, szTree);
+	}
+	else
+		fr = DirList(&dir, szPath);
+	
+	if (fr == DIR_STOP)
+		return FR_OK;
+	
+	if (fr == FR_OK)
+		DirTotal(szPath);
+
+	return fr;
+}
+
+DWORD CpmFileSize(FCB * pfcb)
+{
+	// Size in whole records, all CP/M knows of a file
+	BDOS_FILESIZE((WORD)pfcb);
+	
+	return (((DWORD)pfcb->rn[2] << 16) | ((DWORD)pfcb->rn[1] << 8) | pfcb->rn[0]) * RECLEN;
+}
+
+void ExtRec(DIRREC * prec, const FCB * dirent)
+{
+	int i;
+	
+	// A CP/M directory entry (extent) gives the size of its
+	// file up to the end of the entry
+	for (i = 0; i < CPMFNLEN; i++)
+		prec->name[i] = dirent->name[i] & 0x7F;
+	prec->fsize = ((((DWORD)(dirent->s2 & 0x3F) << 5) | (dirent->ex & 0x1F)) * 128 + dirent->rc) * RECLEN;
+	prec->fdate = 0;
+	prec->ftime = 0;
+	prec->fattrib = 0;
+}
+
+UINT ExtMerge(DIRREC * pRec, UINT n)
+{
+	UINT i, j;
+	
+	DirSort(pRec, n);
+	
+	// One entry per file, the size given by its last extent
+	for (i = 0, j = 0; i < n; i++)
+	{
+		if ((j > 0) && (memcmp(pRec[i].name, pRec[j - 1].name, CPMFNLEN) == 0))
+		{
+			if (pRec[i].fsize > pRec[j - 1].fsize)
+				pRec[j - 1].fsize = pRec[i].fsize;
+		}
+		else
+			pRec[j++] = pRec[i];
+	}
+	
+	return j;
+}
+
+FRESULT SyncIndex(DIR * pDestDir, char * szDestPath)
+{
+	FRESULT fr;
+	FILINFO fno;
+	FCB fcb;
+	FCB * dirent;
+	BYTE buf[RECLEN];
+	UINT nMax;
+	BYTE rc;
+	
+	// COPY /U reads the destination once into a table of names,
+	// sizes and times sorted by name, using up to half of the TPA
+	// left for copying.  Files of a destination too large for that
+	// are looked up one by one (see SyncSame()).
+	pSyncIdx = (DIRREC *)pTpaFree;
+	nMax = (TpaAvail() > XFER_MIN) ? (TpaAvail() - XFER_MIN) / 2 / sizeof(DIRREC) : 0;
+	nSyncIdx = 0;
+	bSyncPart = FALSE;
+	fr = FR_OK;
+	
+	if (IsFatPath(szDestPath))
+	{
+		if (pDestDir == NULL)
+		{
+			bSyncPart = TRUE;
+			return FR_OK;
+		}
+		
+		fr = f_readdir(pDestDir, NULL);		// Rewind
+		while (fr == FR_OK)
+		{
+			fr = f_readdir(pDestDir, &fno);
+			if ((fr != FR_OK) || (fno.fname[0] == '\0'))
+				break;
+			
+			if (fno.fattrib & AM_DIR)
+				continue;
+			
+			if (nSyncIdx == nMax)
+			{
+				bSyncPart = TRUE;
+				break;
+			}
+			
+			DirRec(&pSyncIdx[nSyncIdx++], &fno);
+		}
+	}
+	else
+	{
+		// Every directory entry (extent) of the drive is read, each
+		// gives the size of its file up to the end of the entry
+		memset(&fcb, 0, sizeof(fcb));
+		fcb.drv = CpmDrive(szDestPath) + 1;
+		memset(fcb.name, '?', CPMFNLEN);
+		fcb.ex = '?';
+		fcb.s2 = '?';
+		
+		BDOS_SETDMA((WORD)&buf);
+		
+		for (rc = BDOS_FINDFIRST((WORD)&fcb); rc != 0xFF; rc = BDOS_FINDNEXT((WORD)&fcb))
+		{
+			// A file missing some of its extents would look
+			// smaller, so a partial CP/M index is not used at all
+			if (nSyncIdx == nMax)
+			{
+				nSyncIdx = 0;
+				bSyncPart = TRUE;
+				break;
+			}
+			
+			dirent = (FCB *)(buf + (32 * rc));
+			ExtRec(&pSyncIdx[nSyncIdx++], dirent);
+		}
+	}
+	
+	nSyncIdx = ExtMerge(pSyncIdx, nSyncIdx);
+	
+	TpaAlloc(nSyncIdx * sizeof(DIRREC));
+	
+	return fr;
+}
+
+DIRREC * SyncFind(const char * pName)
+{
+	UINT nLo, nHi, nMid;
+	int n;
+	
+	// Binary search of the COPY /U index
+	nLo = 0;
+	nHi = nSyncIdx;
+	while (nLo < nHi)
+	{
+		nMid = (nLo + nHi) / 2;
+		n = memcmp(pName, pSyncIdx[nMid].name, CPMFNLEN);
+		if (n == 0)
+			return &pSyncIdx[nMid];
+		if (n < 0)
+			nHi = nMid;
+		else
+			nLo = nMid + 1;
+	}
+	
+	return NULL;
+}
+
+int SyncSame(const DIRREC * pSrc, const DIR * pDestDir, char * szDestFile)
+{
+	DIRREC rec;
+	const DIRREC * pDest;
+	FILINFO fno;
+	FCB fcb;
+	
+	RecName(rec.name, FileName(szDestFile));
+	pDest = SyncFind(rec.name);
+	
+	if ((pDest == NULL) && bSyncPart)
+	{
+		// Not in a partial index, look up just this file
+		if (IsFatPath(szDestFile))
+		{
+			if ((f_statat(pDestDir, pDestDir ? FileName(szDestFile) : szDestFile, &fno) == FR_OK) && !(fno.fattrib & AM_DIR))
+			{
+				DirRec(&rec, &fno);
+				pDest = &rec;
+			}
+		}
+		else if (Exists(szDestFile) && (MakeFCB(szDestFile, &fcb) == FR_OK))
+		{
+			rec.fsize = CpmFileSize(&fcb);
+			rec.fdate = 0;
+			pDest = &rec;
+		}
+	}
+	
+	if (pDest == NULL)
+		return FALSE;
+	
+	// Copies are padded to whole records, other tools may not
+	if ((pDest->fsize != pSrc->fsize) && (pDest->fsize != ((pSrc->fsize + RECLEN - 1) & ~(DWORD)(RECLEN - 1))))
+		return FALSE;
+	
+	// Only FAT files have a date, a copy is not older
+	if ((pSrc->fdate == 0) || (pDest->fdate == 0))
+		return TRUE;
+	
+	if (pDest->fdate != pSrc->fdate)
+		return (pDest->fdate > pSrc->fdate);
+	
+	return (pDest->ftime >= pSrc->ftime);
+}
+
+FRESULT FileCrc(const DIR * pdir, char * szFile, DWORD * pdwCrc)
+{
+	FRESULT fr;
+	FILE file;
+	BYTE * pBuf;
+	UINT nBuf, br;
+	
+	// CRC32 register over the whole file (all the records of a
+	// CP/M file), read in large blocks through the free TPA
+	pBuf = pTpaFree;
+	nBuf = XferSize();
+	if (nBuf == 0)
+		return FR_NOT_ENOUGH_CORE;
+	
+	memset(&file, 0, sizeof(file));
+	file.fstyp = IsFatPath(szFile) ? FS_FAT : (pCpmVol ? FS_CPMD : FS_CPM);
+	
+	fr = Open(&file, pdir, szFile, FA_READ);
+	if (fr != FR_OK)
+		return fr;
+	
+	*pdwCrc = 0xFFFFFFFF;
+	do
+	{
+		br = 0;
+		
+		fr = Read(&file, pBuf, nBuf, &br);
+		if (fr != FR_OK)
+			break;
+		
+		*pdwCrc = ff_crc32(*pdwCrc, pBuf, br);
+	} while (br == nBuf);
+	
+	Close(&file);
+	
+	return fr;
+}
+
+FRESULT CopyDelta(FILE * pSrc, FIL * pDest, BYTE * pBuf, UINT nBuf, DWORD * pdwCrc)
+{
+	FRESULT fr;
+	BYTE * pOld;
+	FSIZE_t nPos;
+	DWORD nSect, nNew, dwClst;
+	UINT br, bo, bw, n, i, j, k;
+	
+	// COPY /C reads the existing FAT file along with the source
+	// and only writes the sectors that differ, which are far fewer
+	// than all of them when a large file changed in a few places.
+	// Both files are local, so the blocks are compared directly.
+	nBuf = nBuf / 2;
+	if ((DWORD)pDest->obj.fs->csize * FF_MAX_SS < nBuf)
+		nBuf = pDest->obj.fs->csize * FF_MAX_SS;
+	if (nBuf < CPM_SECSZ)
+		return FR_NOT_ENOUGH_CORE;
+	
+	// A block is a power of two no larger than a cluster, so no
+	// block spans clusters and going back to write a run never
+	// walks the cluster chain again from the start of the file
+	for (n = CPM_SECSZ; n <= nBuf / 2; n *= 2);
+	nBuf = n;
+	pOld = pBuf + nBuf;
+	
+	nPos = 0;
+	nSect = 0;
+	nNew = 0;
+	
+	do
+	{
+		br = 0;
+		
+		fr = Read(pSrc, pBuf, nBuf, &br);
+		if ((fr != FR_OK) || (br == 0))
+			break;
+		
+		// Files are copied in whole records, pad the last
+		n = (br + RECLEN - 1) & ~(RECLEN - 1);
+		memset(pBuf + br, 0x1A, n - br);
+		
+		if (wOpts & OPT_VERIFY)
+			*pdwCrc = ff_crc32(*pdwCrc, pBuf, n);
+		
+		// FatFs can't seek back to the start of the current
+		// cluster without a walk, so keep the block start
+		dwClst = pDest->clust;
+		
+		fr = f_read(pDest, pOld, n, &bo);
+		if (fr != FR_OK)
+			break;
+		
+		nSect += (n + CPM_SECSZ - 1) / CPM_SECSZ;
+		
+		// Write each run of differing sectors, everything past
+		// the old end of the file differs
+		for (i = 0; (fr == FR_OK) && (i < n); i = j)
+		{
+			for (; i < n; i += CPM_SECSZ)
+			{
+				k = (n - i < CPM_SECSZ) ? n - i : CPM_SECSZ;
+				if ((i + k > bo) || memcmp(pBuf + i, pOld + i, k))
+					break;
+			}
+			if (i >= n)
+				break;
+			
+			for (j = i; j < n; j += CPM_SECSZ)
+			{
+				k = (n - j < CPM_SECSZ) ? n - j : CPM_SECSZ;
+				if ((j + k <= bo) && !memcmp(pBuf + j, pOld + j, k))
+					break;
+			}
+			if (j > n)
+				j = n;
+			nNew += (j - i + CPM_SECSZ - 1) / CPM_SECSZ;
+			
+			if (i == 0)
+			{
+				pDest->fptr = nPos;
+				pDest->clust = dwClst;
+			}
+			else
+				fr = f_lseek(pDest, nPos + i);
+			if (fr == FR_OK)
+				fr = f_write(pDest, pBuf + i, j - i, &bw);
+			if ((fr == FR_OK) && (bw < j - i))
+				fr = FR_DISK_ERR;		// Out of space
+		}
+		
+		nPos += n;
+		if (fr == FR_OK)
+			fr = f_lseek(pDest, nPos);
+	} while ((fr == FR_OK) && (br == nBuf));
+	
+	if (fr == FR_OK)
+		printf(" %lu of %lu Sectors Written", nNew, nSect);
+	
+	return fr;
+}
+
+FRESULT CopyFile(const DIR * pSrcDir, char * szSrcFile, const DIR * pDestDir, char * szDestFile, const FILINFO * pfno)
+{
+	FRESULT fr;
+	FILE fileSrc, fileDest;
+	BYTE * pBuf;
+	UINT nBuf, br, bw, n;
+	int bExists;
+	BYTE mode;
+	DWORD dwCrc, dwSum;
+	
+	//printf("\n  CopyFile() %s ==> %s", szSrcFile, szDestFile);
+	printf("\n%s ==> %s", szSrcFile, szDestFile);
+	
+	if (strcmp(szSrcFile, szDestFile) == 0)
+		return FR_INVALID_PARAMETER;
+	
+	memset(&fileSrc, 0, sizeof(fileSrc));
+	memset(&fileDest, 0, sizeof(fileDest));
+	
+	fileSrc.fstyp = IsFatPath(szSrcFile) ? FS_FAT : (pCpmVol ? FS_CPMD : FS_CPM);
+	fileDest.fstyp = IsFatPath(szDestFile) ? FS_FAT : (pCpmVol ? FS_CPMD : FS_CPM);
+
+	//printf("\nSrcFile %s FAT", fileSrc.fstyp == FS_FAT ? "IS" : "NOT");
+	//printf("\nDestFile %s FAT", fileDest.fstyp == FS_FAT ? "IS" : "NOT");
+	
+	// Records move through the free TPA in large blocks
+	pBuf = pTpaFree;
+	nBuf = XferSize();
+	if (nBuf == 0)
+		return FR_NOT_ENOUGH_CORE;
+	
+	fr = Open(&fileSrc, pSrcDir, szSrcFile, FA_READ);
+	if (fr != FR_OK)
+		return fr;
+	
+	if (fileDest.fstyp == FS_FAT)
+	{
+		// A single lookup opens an existing FAT file or creates
+		// a new one.  An existing cluster chain is overwritten in
+		// place and truncated after the copy, rather than being
+		// freed and allocated all over again.  COPY /C reads it too.
+		mode = FA_WRITE | FA_OPEN_ALWAYS;
+		if (wOpts & OPT_DELTA)
+			mode |= FA_READ;
+		fr = Open(&fileDest, pDestDir, szDestFile, mode);
+		bExists = (fr == FR_OK) && !fileDest.fil.created;
+	}
+	else
+		bExists = Exists(szDestFile);
+	
+	if ((fr == FR_OK) && bExists)
+	{
+		// COPY /U only gets here for changed files, which are
+		// replaced without asking
+		if (!(wOpts & OPT_UPDATE))
+		{
+			printf(" Overwrite? (Y/N)");
+			
+			if (!Confirm())
+				fr = 100;	// special case value to indicate "skip file"
+		}
+		
+		if ((fr == FR_OK) && (fileDest.fstyp == FS_CPM))
+			fr = DeleteFile(szDestFile);	// direct create replaces by itself
+		
+		if ((fr != FR_OK) && (fileDest.fstyp == FS_FAT))
+			Close(&fileDest);
+	}
+	
+	if ((fr == FR_OK) && (fileDest.fstyp != FS_FAT))
+		fr = Open(&fileDest, pDestDir, szDestFile, FA_WRITE | FA_CREATE_ALWAYS);
+	
+	if (fr == FR_OK)
+	{
+		printf(" ...");
+		conflush();		// show progress during the copy
+		
+		dwCrc = 0xFFFFFFFF;
+		
+		if ((wOpts & OPT_DELTA) && bExists && (fileDest.fstyp == FS_FAT))
+			fr = CopyDelta(&fileSrc, &fileDest.fil, pBuf, nBuf, &dwCrc);
+		else
+		{
+			do
+			{
+				br = 0;
+			
+				fr = Read(&fileSrc, pBuf, nBuf, &br);
+				
+				if (fr != FR_OK)
+					break;
+				
+				if (br > 0)
+				{
+					// Files are copied in whole records, pad the last
+					n = (br + RECLEN - 1) & ~(RECLEN - 1);
+					memset(pBuf + br, 0x1A, n - br);
+					
+					if (wOpts & OPT_VERIFY)
+						dwCrc = ff_crc32(dwCrc, pBuf, n);
+					
+					bw = 0;
+
+					fr = Write(&fileDest, pBuf, n, &bw);
+
 					if (fr != FR_OK)
 						break;
 					
-					if (bw < RECLEN)
+					if (bw < n)
 					{
 						// This is actually an out of space condition!!!
 						fr = FR_DISK_ERR;
 						break;
 					}
 				}
-			} while (br == RECLEN);
+			} while (br == nBuf);
+		}
+
+		// Release any old clusters beyond the new end of file
+		if ((fr == FR_OK) && (fileDest.fstyp == FS_FAT))
+			fr = f_truncate(&fileDest.fil);
+		
+		// A FAT copy of a FAT file keeps its date and time
+		if ((fr == FR_OK) && (fileDest.fstyp == FS_FAT) && pfno)
+			fr = f_futime(&fileDest.fil, pfno);
+
+		// The last sector of the file may only be written now
+		if (fr == FR_OK)
+			fr = Close(&fileDest);
+		else
+			Close(&fileDest);
+		
+		// COPY /V reads the file back once it is closed and
+		// compares it with the CRC32 of the data written
+		if ((fr == FR_OK) && (wOpts & OPT_VERIFY))
+		{
+			fr = FileCrc(pDestDir, szDestFile, &dwSum);
+			if ((fr == FR_OK) && (dwSum != dwCrc))
+			{
+				printf(" [Verify Failed]");
+				fr = FR_DISK_ERR;
+			}
+		}
+	}
+	
+	Close(&fileSrc);
+	
+	return fr;
+}
+
+FRESULT CopyFiles(DIR * pdir, char * szSrcPath, DIR * pDestDir, char * szDestPath, char * szDestSpec)
+{
+	FRESULT fr;
+	FILINFO fno;
+	DIRREC rec;
+	BYTE * pIdx;
+	char szSrcFile[MAX_PATH];
+	char szDestFile[MAX_PATH];
+	
+	// Copy the files of the open source directory that match its
+	// pattern (set by f_findfirst()), from the start.  Files are
+	// opened by name in the source and destination directories,
+	// not by walking the full paths again each time.
+	pIdx = pTpaFree;
+	fr = FR_OK;
+	if ((wOpts & OPT_UPDATE) && IsFatPath(szDestPath))
+		fr = SyncIndex(pDestDir, szDestPath);
+	
+	if (fr == FR_OK)
+		fr = f_readdir(pdir, NULL);		// Rewind
+	while (fr == FR_OK)
+	{
+		fr = f_findnext(pdir, &fno);
+		if ((fr != FR_OK) || (fno.fname[0] == '\0'))
+			break;
+		
+		if (fno.fattrib & AM_DIR)
+			continue;
+		
+		//printf("\n%s", fno.fname);
+
+		strncpy(szSrcFile, szSrcPath, sizeof(szSrcFile) - 1);
+		strncat(szSrcFile, "/", sizeof(szSrcFile) - 1);
+		strncat(szSrcFile, fno.fname, sizeof(szSrcFile) - 1);
+		
+		strncpy(szDestFile, szDestPath, sizeof(szDestFile) - 1);
+		if (IsFatPath(szDestPath))
+			strncat(szDestFile, "/", sizeof(szDestFile) - 1);
+		strncat(szDestFile, (*szDestSpec == '\0') ? fno.fname : szDestSpec, sizeof(szDestFile) - 1);
+		
+		if (wOpts & OPT_UPDATE)
+		{
+			DirRec(&rec, &fno);
+			if (SyncSame(&rec, pDestDir, szDestFile))
+			{
+				nSame++;
+				continue;
+			}
+		}
+		
+		fr = CopyFile(pdir, szSrcFile, pDestDir, szDestFile, &fno);
+		if (fr == FR_OK)
+		{
+			printf(" [OK]");
+			nCopied++;
+		}
+		if (fr == 100)
+		{
+			printf(" [Skipped]");
+			fr = FR_OK;
+		}
+	}
+	
+	TpaRelease(pIdx);
+	
+	return fr;
+}
+
+FRESULT CopyTree(DIR * pdir, char * szSrcPath, DIR * pDestDir, char * szDestPath)
+{
+	FRESULT fr;
+	FILINFO fno;
+	DIRFRAME * pStack;
+	DIRFRAME * pFrame;
+	DWORD dwDestTop;
+	UINT nDepth, nLen, nDest;
+	int bDone;
+	
+	// Walked like DirTree(), with the destination directory object
+	// following the source down and back up.  Destination
+	// directories are made as they are reached, a CP/M destination
+	// gets all files of the tree.
+	pStack = (DIRFRAME *)pTpaFree;
+	dwDestTop = pDestDir ? pDestDir->obj.sclust : 0;
+	nDepth = 0;
+	bDone = FALSE;
+	
+	do
+	{
+		fr = CopyFiles(pdir, szSrcPath, pDestDir, szDestPath, "");
+		if (fr != FR_OK)
+			break;
+		
+		fr = f_readdir(pdir, NULL);		// Rewind
+		while (fr == FR_OK)
+		{
+			fr = f_readdir(pdir, &fno);
+			if (fr != FR_OK)
+				break;
+			
+			if (fno.fname[0] == '\0')
+			{
+				if (nDepth == 0)
+				{
+					bDone = TRUE;
+					break;
+				}
+				pFrame = &pStack[--nDepth];
+				szSrcPath[pFrame->nPath] = '\0';
+				szDestPath[pFrame->nDest] = '\0';
+				fr = f_dirat(pdir, pFrame->sclust, pFrame->ofs);
+				if ((fr == FR_OK) && pDestDir)
+					fr = f_dirat(pDestDir, pFrame->dclust, 0);
+				TpaRelease(pFrame);
+				continue;
+			}
+			
+			if (!(fno.fattrib & AM_DIR))
+				continue;
+			
+			// Never copy the destination into itself when it is
+			// inside the source tree
+			if (pDestDir && (pDestDir->obj.fs == pdir->obj.fs) && (fno.fclust == dwDestTop))
+				continue;
+			
+			nLen = strlen(szSrcPath);
+			nDest = strlen(szDestPath);
+			if ((nLen + strlen(fno.fname) + 1 > MAX_PATH) || (nDest + strlen(fno.fname) + 1 > MAX_PATH))
+			{
+				fr = FR_INVALID_NAME;
+				break;
+			}
+			
+			if (pdir->sect != 0)
+			{
+				pFrame = TpaAlloc(sizeof(DIRFRAME));
+				if (pFrame == NULL)
+				{
+					fr = FR_NOT_ENOUGH_CORE;
+					break;
+				}
+				pFrame->sclust = pdir->obj.sclust;
+				pFrame->ofs = pdir->dptr;
+				pFrame->nPath = nLen;
+				pFrame->dclust = pDestDir ? pDestDir->obj.sclust : 0;
+				pFrame->nDest = nDest;
+				nDepth++;
+			}
+			
+			if ((nLen == 0) || (szSrcPath[nLen - 1] != '/'))
+				strcat(szSrcPath, "/");
+			strcat(szSrcPath, fno.fname);
+			
+			fr = f_dirat(pdir, fno.fclust, 0);
+			
+			if ((fr == FR_OK) && pDestDir)
+			{
+				if ((nDest == 0) || (szDestPath[nDest - 1] != '/'))
+					strcat(szDestPath, "/");
+				strcat(szDestPath, fno.fname);
+				
+				// The new directory is looked up once by path
+				fr = f_mkdir(szDestPath);
+				if (fr == FR_EXIST)
+					fr = FR_OK;
+				if (fr == FR_OK)
+					fr = f_stat(szDestPath, &fno);
+				if ((fr == FR_OK) && !(fno.fattrib & AM_DIR))
+					fr = FR_EXIST;
+				if (fr == FR_OK)
+					fr = f_dirat(pDestDir, fno.fclust, 0);
+			}
+			break;
+		}
+	}
+	while ((fr == FR_OK) && !bDone);
+	
+	TpaRelease(pStack);
+	
+	return fr;
+}
+
+FRESULT FatCopy(char * szSrcPath, char * szDestPath)
+{
+	FRESULT fr;
+	DIR dir, dirDest;
+	DIR * pDestDir;
+	FILINFO fno;
+	BYTE * pIdx;
+	char szSrcSpec[MAX_FN];
+	char szDestSpec[MAX_FN];
+	char szSrcTree[MAX_PATH + 1];
+	char szDestTree[MAX_PATH + 1];
+
+	// printf("\nFatCopy()...");
+	
+	nCopied = 0;
+	nSame = 0;
+
+	// COPY /S of a directory copies all of it
+	fr = f_stat(szSrcPath, &fno);
+	
+	if ((wOpts & OPT_SUBDIR) && (fr == FR_OK) && (fno.fattrib & AM_DIR))
+		strcpy(szSrcSpec, "*");
+	else
+		fr = SplitPath(szSrcPath, szSrcSpec);
+	if (fr != FR_OK)
+		return fr;
+	
+	if (IsFatPath(szDestPath))
+	{
+		fr = f_stat(szDestPath, &fno);
+		//printf("\nf_stat=%i", fr);
 
-			Close(&fileDest);
+		// COPY /S always copies into a directory, made if needed
+		if ((fr == FR_NO_FILE) && (wOpts & OPT_SUBDIR))
+		{
+			fr = f_mkdir(szDestPath);
+			if (fr != FR_OK)
+				return fr;
+			fno.fattrib = AM_DIR;
 		}
 
-		Close(&fileSrc);
+		if ((fr == FR_OK) && (fno.fattrib & AM_DIR))
+			*szDestSpec = '\0';
+		else
+			fr = SplitPath(szDestPath, szDestSpec);
+		
+		//printf("\nSplitPath=%i", fr);
+		//printf("\nszDestPath='%s', szDestSpec='%s'", szDestPath, szDestSpec);
+	}
+	else
+		fr = SplitPath(szDestPath, szDestSpec);
+
+	if (fr != FR_OK)
+		return fr;
+	
+	if (*szSrcSpec == '\0')
+		return FR_INVALID_PARAMETER;
+	
+	if ((IsWild(szSrcSpec) || (wOpts & OPT_SUBDIR)) && (*szDestSpec != '\0'))
+		return FR_INVALID_PARAMETER;
+	
+	//printf("\n  szSrcPath: %s\n  szSrcSpec: %s", szSrcPath, szSrcSpec);
+	
+	fr = f_findfirst(&dir, &fno, szSrcPath, szSrcSpec);
+	
+	if (fr == FR_OK)
+		printf("\nCopying...\n");
+	else
+		return FR_NO_FILE;
+
+	pDestDir = NULL;
+	if (IsFatPath(szDestPath))
+	{
+		fr = f_opendir(&dirDest, szDestPath);
+		if (fr == FR_OK)
+			pDestDir = &dirDest;
+		else if (!(wOpts & OPT_SUBDIR))
+			fr = FR_OK;		// files are then opened by path
+	}
+	
+	// A CP/M destination is indexed once for the whole copy, a FAT
+	// destination for each directory by CopyFiles()
+	pIdx = pTpaFree;
+	if ((fr == FR_OK) && (wOpts & OPT_UPDATE) && !IsFatPath(szDestPath))
+		fr = SyncIndex(NULL, szDestPath);
+
+	if ((fr == FR_OK) && (wOpts & OPT_SUBDIR))
+	{
+		strcpy(szSrcTree, szSrcPath);
+		strcpy(szDestTree, szDestPath);
+		fr = CopyTree(&dir, szSrcTree, pDestDir, szDestTree);
 	}
+	else if (fr == FR_OK)
+		fr = CopyFiles(&dir, szSrcPath, pDestDir, szDestPath, szDestSpec);
 	
+	TpaRelease(pIdx);
+	
+	if (pDestDir)
+		f_closedir(pDestDir);
+	
+	printf("\n\n    %i File(s) Copied", nCopied);
+	if (wOpts & OPT_UPDATE)
+		printf(", %i Unchanged", nSame);
+
 	return fr;
 }
 
-FRESULT FatCopy(char * szSrcPath, char * szDestPath)
+char * CpmFileName(char * szFile, BYTE drv, const BYTE * pName)
+{
+	char * p;
+	char * p2;
+	int n;
+	
+	// Build d:NAME.EXT from the name of a CP/M directory entry,
+	// returning where the name starts
+	p = szFile;
+	
+	if (drv > 0)
+	{
+		*(p++) = drv + 'A' - 1;
+		*(p++) = ':';
+	}
+	
+	p2 = p;			// Remember start of filename/ext
+	
+	for (n = 0; n < 8; n++)
+	{
+		if (pName[n] == ' ')
+			break;
+		*(p++) = pName[n] & 0x7F;
+	}
+	
+	*(p++) = '.';
+	
+	for (n = 8; n < 11; n++)
+	{
+		if (pName[n] == ' ')
+			break;
+		*(p++) = pName[n] & 0x7F;
+	}
+
+	*(p++) = '\0';
+	
+	return p2;
+}
+
+FRESULT CpmCopy(char * szSrcPath, char * szDestPath)
 {
 	FRESULT fr;
+	int rc;
 	int nFiles;
-	DIR dir;
+	FCB fcbSave, fcbSrch;
+	BYTE buf[RECLEN];
+	FCB * dirent;
 	FILINFO fno;
+	DIR dirDest;
+	DIR * pDestDir;
 	char szSrcSpec[MAX_FN];
 	char szDestSpec[MAX_FN];
+	BYTE * pList;
+	BYTE * pIdx;
+	int nList, nMax;
+	int nEntry, nSkip;
+	int bSizes, bStarted;
+	UINT nRec;
 
-	// printf("\nFatCopy()...");
+	szDestPath;
+
+	// printf("\nCpmCopy()...");
 	
 	nFiles = 0;
-
+	
+	fr = MakeFCB(szSrcPath, &fcbSrch);
+  
+  // DumpFCB(&fcbSrch);
+  
+  memcpy(&fcbSave, &fcbSrch, sizeof(fcbSave));
+	
+	if (fr != FR_OK)
+		return fr;
+	
 	fr = SplitPath(szSrcPath, szSrcSpec);
 	if (fr != FR_OK)
 		return fr;
@@ -653,35 +2195,141 @@ FRESULT FatCopy(char * szSrcPath, char * szDestPath)
 	
 	if (IsWild(szSrcSpec) && (*szDestSpec != '\0'))
 		return FR_INVALID_PARAMETER;
+  
+	pDestDir = NULL;
+	if (IsFatPath(szDestPath) && (f_opendir(&dirDest, szDestPath) == FR_OK))
+		pDestDir = &dirDest;
+	
+	// COPY /U index of the destination goes below the name list
+	pIdx = pTpaFree;
+	nSame = 0;
+	if (wOpts & OPT_UPDATE)
+		fr = SyncIndex(pDestDir, szDestPath);
+	
+	// Directory is enumerated once into a compact list of
+	// CP/M names in free TPA.  Only if the list fills all of the
+	// free TPA is the search restarted (skipping the entries
+	// already listed) to collect the next block of names.
+	// COPY /U lists every extent with its size instead, so the
+	// size of each file is known without a BDOS call per file.
+	// Such a list must hold all the extents, if it does not fit
+	// it is made again without sizes.
+	bSizes = ((wOpts & OPT_UPDATE) != 0);
+	nRec = bSizes ? sizeof(DIRREC) : CPMFNLEN;
+	pList = pTpaFree;
+	nMax = (TpaAvail() > XFER_MIN) ? (TpaAvail() - XFER_MIN) / nRec : 0;
+	if ((fr == FR_OK) && (nMax < 1))
+		fr = FR_NOT_ENOUGH_CORE;
 	
-	//printf("\n  szSrcPath: %s\n  szSrcSpec: %s", szSrcPath, szSrcSpec);
+	if (fr != FR_OK)
+	{
+		TpaRelease(pIdx);
+		if (pDestDir)
+			f_closedir(pDestDir);
+		return fr;
+	}
 	
-	fr = f_findfirst(&dir, &fno, szSrcPath, szSrcSpec);
+	nSkip = 0;
+	bStarted = FALSE;
 	
-	if (fr == FR_OK)
-		printf("\nCopying...\n");
-	else
-		return FR_NO_FILE;
-
-	while ((fr == FR_OK) && (fno.fname[0]))
+	do
 	{
-		char szSrcFile[MAX_PATH];
-		char szDestFile[MAX_PATH];
+		memcpy(&fcbSrch, &fcbSave, sizeof(fcbSrch));
+		if (bSizes)
+		{
+			fcbSrch.ex = '?';
+			fcbSrch.s2 = '?';
+		}
 		
-		if (!(fno.fattrib & AM_DIR))
+		BDOS_SETDMA((WORD)&buf);
+		
+		rc = BDOS_FINDFIRST((WORD)&fcbSrch);
+		
+		// printf("\nBDOS FindFirst(): %i", rc);
+		
+		if (!bStarted)
+		{
+			if (rc == 0xFF)
+			{
+				fr = FR_NO_FILE;
+				break;
+			}
+			printf("\nCopying...\n");
+			bStarted = TRUE;
+		}
+		
+		for (nEntry = 0; (rc != 0xFF) && (nEntry < nSkip); nEntry++)
+			rc = BDOS_FINDNEXT((WORD)&fcbSrch);
+		
+		nList = 0;
+
+		while ((rc != 0xFF) && (nList < nMax))
+		{
+			dirent = (FCB *)(buf + (32 * rc));
+			
+			// DumpFCB(dirent);
+			
+			if (bSizes)
+				ExtRec((DIRREC *)pList + nList, dirent);
+			else
+				memcpy(pList + (nList * CPMFNLEN), dirent->name, CPMFNLEN);
+			nList++;
+
+			rc = BDOS_FINDNEXT((WORD)&fcbSrch);
+		}
+		
+		if (bSizes && (rc != 0xFF))
+		{
+			// Too many extents, list the names only
+			bSizes = FALSE;
+			nRec = CPMFNLEN;
+			nMax = (TpaAvail() > XFER_MIN) ? (TpaAvail() - XFER_MIN) / nRec : 0;
+			continue;
+		}
+		
+		nSkip += nList;
+		if (bSizes)
+			nList = ExtMerge((DIRREC *)pList, nList);
+		TpaAlloc(nList * nRec);		// Copy buffer follows list
+
+		for (nEntry = 0; (fr == FR_OK) && (nEntry < nList); nEntry++)
 		{
-			//printf("\n%s", fno.fname);
+			char szSrcFile[MAX_PATH];
+			char szDestFile[MAX_PATH];
+			char *p2;
 
-			strncpy(szSrcFile, szSrcPath, sizeof(szSrcFile) - 1);
-			strncat(szSrcFile, "/", sizeof(szSrcFile) - 1);
-			strncat(szSrcFile, fno.fname, sizeof(szSrcFile) - 1);
+			p2 = CpmFileName(szSrcFile, fcbSrch.drv, pList + (nEntry * nRec));
 			
 			strncpy(szDestFile, szDestPath, sizeof(szDestFile) - 1);
 			if (IsFatPath(szDestPath))
 				strncat(szDestFile, "/", sizeof(szDestFile) - 1);
-			strncat(szDestFile, (*szDestSpec == '\0') ? fno.fname : szDestSpec, sizeof(szDestFile) - 1);
+			strncat(szDestFile, (*szDestSpec == '\0') ? p2 : szDestSpec, sizeof(szDestFile) - 1);
+			
+			// printf("\nCopy File: %s", szSrcFile);
+			
+			if (wOpts & OPT_UPDATE)
+			{
+				DIRREC rec;
+				FCB fcb;
+				
+				if (bSizes)
+					rec.fsize = ((DIRREC *)pList)[nEntry].fsize;
+				else
+				{
+					fr = MakeFCB(szSrcFile, &fcb);
+					if (fr != FR_OK)
+						break;
+					rec.fsize = CpmFileSize(&fcb);
+				}
+				rec.fdate = 0;
+				if (SyncSame(&rec, pDestDir, szDestFile))
+				{
+					nSame++;
+					continue;
+				}
+			}
 			
-			fr = CopyFile(szSrcFile, szDestFile);
+			fr = CopyFile(NULL, szSrcFile, pDestDir, szDestFile, NULL);
 			if (fr == FR_OK)
 			{
 				printf(" [OK]");
@@ -694,257 +2342,319 @@ FRESULT FatCopy(char * szSrcPath, char * szDestPath)
 			}
 		}
 		
-		if (fr == FR_OK)
-			fr = f_findnext(&dir, &fno);
+		TpaRelease(pList);
+	} while ((fr == FR_OK) && (rc != 0xFF));
+
+	TpaRelease(pIdx);
+	
+	if (pDestDir)
+		f_closedir(pDestDir);
+
+	if (fr != FR_OK)
+		return fr;
+
+	printf("\n\n    %i File(s) Copied", nFiles);
+	if (wOpts & OPT_UPDATE)
+		printf(", %i Unchanged", nSame);
+
+	return fr;
+
+/**************************************************
+	
+	while (rc != 0xFF)
+	{
+
+	
+		BDOS_SETDMA((WORD)&buf);
+
+		// Restart search from last file found
+		memcpy(fcb.name, dirent->name, sizeof(fcb.name));
+		memcpy(fcb.ext, dirent->ext, sizeof(fcb.ext));
+		memset(&fcb + 12, 0, sizeof(fcb) - 12);
+		rc = BDOS_FINDFIRST((WORD)&fcb);
+		if (rc == 0xFF)
+			return FR_INVALID_OBJECT;
+		
+		//printf("\nBDOS FindFirst(): %i", rc);
+	
+		// Restore the search spec and find next
+		memcpy(&fcb.name, &fcbSave.name, sizeof(fcb.name));
+		memcpy(&fcb.ext, &fcbSave.ext, sizeof(fcb.ext));
+		rc = BDOS_FINDNEXT((WORD)&fcb);
+
+		//printf("\nBDOS FindNext(): %i", rc);
 	}
 	
 	printf("\n\n    %i File(s) Copied", nFiles);
 
 	return fr;
+
+***********************************************************/
 }
 
-FRESULT CpmCopy(char * szSrcPath, char * szDestPath)
+FRESULT Copy(void)
 {
 	FRESULT fr;
-	int rc;
-	int nFiles;
-	FCB fcbSave, fcbSrch;
-	BYTE buf[RECLEN];
-	FCB * dirent;
-	FILINFO fno;
-	char szSrcSpec[MAX_FN];
-	char szDestSpec[MAX_FN];
-  
-  int nEntry, nSkip;
+	CPMVOL cv;
+	char * szSrcPath;
+	char * szDestPath;
+	
+	szSrcPath = NextParm();
+	if (szSrcPath == NULL)
+		return FR_INVALID_PARAMETER;
 
-	szDestPath;
+	szDestPath = NextParm();
+	if (szDestPath == NULL)
+		return FR_INVALID_PARAMETER;
 
-	// printf("\nCpmCopy()...");
+	NextParm();		// Pick up any trailing switches
 	
-	nFiles = 0;
+	// DIR sort keys would also upset the COPY /U index order
+	if (wOpts & (OPT_BAD | OPT_SORT | OPT_PAGE))
+		return FR_INVALID_PARAMETER;
+
+	if (wOpts & OPT_DIRECT)
+	{
+		// Direct access handles the one CP/M side of the copy
+		// via HBIOS, so exactly one side must be FAT
+		if (IsFatPath(szSrcPath) == IsFatPath(szDestPath))
+			return FR_INVALID_PARAMETER;
+		
+		fr = cpm_mount(&cv, CpmDrive(IsFatPath(szSrcPath) ? szDestPath : szSrcPath));
+		if (fr != FR_OK)
+			return fr;
+		
+		pCpmVol = &cv;
+	}
+
+	fr = FR_OK;
+
+	if (IsFatPath(szSrcPath))
+		fr = Mount(szSrcPath, 1);
 	
-	fr = MakeFCB(szSrcPath, &fcbSrch);
-  
-  // DumpFCB(&fcbSrch);
-  
-  memcpy(&fcbSave, &fcbSrch, sizeof(fcbSave));
+	if ((fr == FR_OK) && (IsFatPath(szDestPath)))
+		fr = Mount(szDestPath, 1);
+
+	if (fr == FR_OK)
+	{
+		if (IsFatPath(szSrcPath))
+			fr = FatCopy(szSrcPath, szDestPath);
+		else
+			fr = CpmCopy(szSrcPath, szDestPath);
+	}
 	
-	if (fr != FR_OK)
-		return fr;
+	if (pCpmVol)
+	{
+		if (fr == FR_OK)
+			fr = cpm_unmount(pCpmVol);
+		else
+			cpm_unmount(pCpmVol);
+		pCpmVol = NULL;
+	}
+
+	return fr;
+}
+
+FRESULT FatSum(char * szPath, int * pnFiles)
+{
+	FRESULT fr;
+	DIR dir;
+	FILINFO fno;
+	DWORD dwCrc;
+	char szFileSpec[MAX_FN];
+	char szFile[MAX_PATH];
 	
-	fr = SplitPath(szSrcPath, szSrcSpec);
+	fr = Mount(szPath, 0);
 	if (fr != FR_OK)
 		return fr;
 	
-	if (IsFatPath(szDestPath))
+	fr = f_stat(szPath, &fno);
+
+	if ((fr == FR_OK) && (fno.fattrib & AM_DIR))
+		*szFileSpec = '\0';
+	else
+		fr = SplitPath(szPath, szFileSpec);
+
+	if (*szFileSpec == '\0')
+		strcpy(szFileSpec, "*");
+	
+	if (fr == FR_OK)
+		fr = f_findfirst(&dir, &fno, szPath, szFileSpec);
+	
+	while ((fr == FR_OK) && (fno.fname[0] != '\0'))
 	{
-		fr = f_stat(szDestPath, &fno);
-		//printf("\nf_stat=%i", fr);
-
-		if ((fr == FR_OK) && (fno.fattrib & AM_DIR))
-			*szDestSpec = '\0';
-		else
-			fr = SplitPath(szDestPath, szDestSpec);
+		if (!(fno.fattrib & AM_DIR))
+		{
+			strncpy(szFile, szPath, sizeof(szFile) - 1);
+			strncat(szFile, "/", sizeof(szFile) - 1);
+			strncat(szFile, fno.fname, sizeof(szFile) - 1);
+			
+			fr = FileCrc(&dir, szFile, &dwCrc);
+			if (fr != FR_OK)
+				break;
+			
+			printf("\n%08lX  %s", dwCrc ^ 0xFFFFFFFF, szFile);
+			(*pnFiles)++;
+		}
 		
-		//printf("\nSplitPath=%i", fr);
-		//printf("\nszDestPath='%s', szDestSpec='%s'", szDestPath, szDestSpec);
+		fr = f_findnext(&dir, &fno);
 	}
-	else
-		fr = SplitPath(szDestPath, szDestSpec);
+	
+	return fr;
+}
 
+FRESULT CpmSum(char * szPath, int * pnFiles)
+{
+	FRESULT fr;
+	int rc;
+	FCB fcbSave, fcbSrch;
+	BYTE buf[RECLEN];
+	BYTE * pList;
+	int nList, nMax;
+	int nEntry, nSkip;
+	DWORD dwCrc;
+	char szFile[MAX_PATH];
+	
+	fr = MakeFCB(szPath, &fcbSave);
 	if (fr != FR_OK)
 		return fr;
 	
-	if (*szSrcSpec == '\0')
-		return FR_INVALID_PARAMETER;
+	// Opening a file upsets the BDOS search, so the names are
+	// listed in free TPA first as COPY does
+	pList = pTpaFree;
+	nMax = (TpaAvail() > XFER_MIN) ? (TpaAvail() - XFER_MIN) / CPMFNLEN : 0;
+	if (nMax < 1)
+		return FR_NOT_ENOUGH_CORE;
 	
-	if (IsWild(szSrcSpec) && (*szDestSpec != '\0'))
-		return FR_INVALID_PARAMETER;
-  
-  nSkip = 0;
-  rc = 0;
-  
-  while (rc != 0xFF)
-  {
-    char FileList[CHUNKSIZE][12];
-    
-    memcpy(&fcbSrch, &fcbSave, sizeof(fcbSrch));
-    
-    // DumpFCB(&fcbSrch);
-    
-    BDOS_SETDMA((WORD)&buf);
-    
-    rc = BDOS_FINDFIRST((WORD)&fcbSrch);
-    
-    // printf("\nBDOS FindFirst(): %i", rc);
-    
-    if (nSkip == 0)
-    {
-      if (rc == 0xFF)
-        return FR_NO_FILE;
-      printf("\nCopying...\n");
-    }
-    
-    nEntry = 0;
-
-    while ((rc != 0xFF) && (nEntry < nSkip))
-    {
-      rc = BDOS_FINDNEXT((WORD)&fcbSrch);
-      nEntry++;
-    }
-    
-    nEntry = 0;
-
-    while ((rc != 0xFF) && (nEntry < CHUNKSIZE))
-    {
-      dirent = (FCB *)(buf + (32 * rc));
-      
-      // DumpFCB(dirent);
-      
-      memcpy(FileList[nEntry], dirent, sizeof(FileList[0]));
-      
-      nEntry++;
-      nSkip++;
-
-      rc = BDOS_FINDNEXT((WORD)&fcbSrch);
-    }
-
-    for (int iFile = 0; iFile < nEntry; iFile++)
-    {
-      char szSrcFile[MAX_PATH];
-      char szDestFile[MAX_PATH];
-      char *p, *p2;
-      int n;
-
-      dirent = (FCB *)FileList[iFile];
-      p = szSrcFile;
-      
-      // DumpFCB(dirent);
-
-      if (fcbSrch.drv > 0)
-      {
-        *(p++) = fcbSrch.drv + 'A' - 1;
-        *(p++) = ':';
-      }
-      
-      p2 = p;			// Remember start of filename/ext
-      
-      for (n = 0; n < 8; n++)
-      {
-        if (dirent->name[n] == ' ')
-          break;
-        *(p++) = dirent->name[n] & 0x7F;
-      }
-      
-      *(p++) = '.';
-      
-      for (n = 0; n < 3; n++)
-      {
-        if (dirent->ext[n] == ' ')
-          break;
-        *(p++) = dirent->ext[n] & 0x7F;
-      }
-
-      *(p++) = '\0';
-      
-      strncpy(szDestFile, szDestPath, sizeof(szDestFile) - 1);
-      if (IsFatPath(szDestPath))
-        strncat(szDestFile, "/", sizeof(szDestFile) - 1);
-      strncat(szDestFile, (*szDestSpec == '\0') ? p2 : szDestSpec, sizeof(szDestFile) - 1);
-      
-      // printf("\nCopy File: %s", szSrcFile);
-      
-      fr = CopyFile(szSrcFile, szDestFile);
-      if (fr == FR_OK)
-      {
-        printf(" [OK]");
-        nFiles++;
-      }
-      if (fr == 100)
-      {
-        printf(" [Skipped]");
-        fr = FR_OK;
-      }
-      if (fr != FR_OK)
-        return fr;
-    }
-  }
-
-	printf("\n\n    %i File(s) Copied", nFiles);
-
-  return fr;
-
-/**************************************************
+	nSkip = 0;
 	
-	while (rc != 0xFF)
+	do
 	{
-
-	
+		memcpy(&fcbSrch, &fcbSave, sizeof(fcbSrch));
+		
 		BDOS_SETDMA((WORD)&buf);
-
-		// Restart search from last file found
-		memcpy(fcb.name, dirent->name, sizeof(fcb.name));
-		memcpy(fcb.ext, dirent->ext, sizeof(fcb.ext));
-		memset(&fcb + 12, 0, sizeof(fcb) - 12);
-		rc = BDOS_FINDFIRST((WORD)&fcb);
-		if (rc == 0xFF)
-			return FR_INVALID_OBJECT;
 		
-		//printf("\nBDOS FindFirst(): %i", rc);
-	
-		// Restore the search spec and find next
-		memcpy(&fcb.name, &fcbSave.name, sizeof(fcb.name));
-		memcpy(&fcb.ext, &fcbSave.ext, sizeof(fcb.ext));
-		rc = BDOS_FINDNEXT((WORD)&fcb);
-
-		//printf("\nBDOS FindNext(): %i", rc);
-	}
+		rc = BDOS_FINDFIRST((WORD)&fcbSrch);
+		
+		for (nEntry = 0; (rc != 0xFF) && (nEntry < nSkip); nEntry++)
+			rc = BDOS_FINDNEXT((WORD)&fcbSrch);
+		
+		for (nList = 0; (rc != 0xFF) && (nList < nMax); nList++)
+		{
+			memcpy(pList + (nList * CPMFNLEN), ((FCB *)(buf + (32 * rc)))->name, CPMFNLEN);
+			rc = BDOS_FINDNEXT((WORD)&fcbSrch);
+		}
+		
+		nSkip += nList;
+		TpaAlloc(nList * CPMFNLEN);	// Read buffer follows list
+		
+		for (nEntry = 0; (fr == FR_OK) && (nEntry < nList); nEntry++)
+		{
+			CpmFileName(szFile, fcbSrch.drv, pList + (nEntry * CPMFNLEN));
+			
+			fr = FileCrc(NULL, szFile, &dwCrc);
+			if (fr != FR_OK)
+				break;
+			
+			printf("\n%08lX  %s", dwCrc ^ 0xFFFFFFFF, szFile);
+			(*pnFiles)++;
+		}
+		
+		TpaRelease(pList);
+	} while ((fr == FR_OK) && (rc != 0xFF));
 	
-	printf("\n\n    %i File(s) Copied", nFiles);
-
 	return fr;
-
-***********************************************************/
 }
 
-FRESULT Copy(void)
+FRESULT Sum(void)
 {
 	FRESULT fr;
-	FATFS fsSrc;
-	FATFS fsDest;
-	char * szSrcPath;
-	char * szDestPath;
+	char * szPath;
+	int nFiles;
 	
-	szSrcPath = strtok(NULL, " ");
-	if (szSrcPath == NULL)
+	szPath = NextParm();
+	if (szPath == NULL)
 		return FR_INVALID_PARAMETER;
 
-	szDestPath = strtok(NULL, " ");
-	if (szDestPath == NULL)
+	NextParm();		// Pick up any trailing switches
+	
+	if (wOpts)
 		return FR_INVALID_PARAMETER;
+	
+	// CRC32 of each file as zip and most checksum tools show it,
+	// CP/M files include the padding of their last record
+	nFiles = 0;
+	
+	if (IsFatPath(szPath))
+		fr = FatSum(szPath, &nFiles);
+	else
+		fr = CpmSum(szPath, &nFiles);
+	
+	if (fr != FR_OK)
+		return fr;
+	
+	if (nFiles == 0)
+		return FR_NO_FILE;
+	
+	printf("\n\n    %i File(s)", nFiles);
+	
+	return fr;
+}
 
-	fr = FR_OK;
+void ShowRenamed(const FILINFO * pfnoOld, const FILINFO * pfnoNew)
+{
+	printf("\n%s/%s ==> %s/%s", szShowPath, pfnoOld->fname, szShowPath, pfnoNew->fname);
+}
 
-	if (IsFatPath(szSrcPath))
-		fr = f_mount(&fsSrc, szSrcPath, 1);
+FRESULT RenameWild(char * szSrcPath, char * szSrcSpec, char * szDestPath, char * szDestSpec)
+{
+	FRESULT fr;
+	DIR dir, dirDest;
+	UINT nFiles;
 	
-	if ((fr == FR_OK) && (IsFatPath(szDestPath)))
+	nFiles = 0;
+	
+	fr = f_opendir(&dir, szSrcPath);
+	if (fr != FR_OK)
+		return fr;
+	
+	// Files are renamed in place, so any destination
+	// path must name the source directory
+	if (*szDestPath)
 	{
-		fr = f_mount(&fsDest, szDestPath, 1);
-		if (fr != FR_OK)
-			return fr;
+		fr = f_opendir(&dirDest, szDestPath);
+		if (fr == FR_NOT_ENABLED)
+			fr = FR_INVALID_PARAMETER;		// not the source drive
+		
+		if (fr == FR_OK)
+		{
+			if ((dirDest.obj.fs != dir.obj.fs) || (dirDest.obj.sclust != dir.obj.sclust))
+				fr = FR_INVALID_PARAMETER;
+			
+			f_closedir(&dirDest);
+		}
 	}
-
+	
 	if (fr == FR_OK)
 	{
-		if (IsFatPath(szSrcPath))
-			fr = FatCopy(szSrcPath, szDestPath);
-		else
-			fr = CpmCopy(szSrcPath, szDestPath);
+		printf("\nRenaming...\n");
+		
+		// All matches are renamed in one pass, with the
+		// names of the directory collected in free TPA
+		szShowPath = szSrcPath;
+		fr = f_renamefind(&dir, szSrcSpec, szDestSpec, pTpaFree,
+			TpaAvail(), &nFiles, ShowRenamed);
 	}
 	
-	f_mount(0, szSrcPath, 0);		// unmount ignoring any errors
-	f_mount(0, szDestPath, 0);		// unmount ignoring any errors
+	f_closedir(&dir);
+	
+	if (fr != FR_OK)
+		return fr;
+
+	if (nFiles)
+		printf("\n\n    %u File(s) Renamed", nFiles);
+	else
+		fr = FR_NO_FILE;
 
 	return fr;
 }
@@ -953,7 +2663,6 @@ FRESULT Rename(void)
 {
 	FRESULT fr;
 	int nFiles;
-	FATFS fsSrc;
 	DIR dir;
 	FILINFO fno;
 	char * szSrcPath;
@@ -993,13 +2702,16 @@ FRESULT Rename(void)
 	//if (*szDestSpec == '\0')
 	//	return FR_INVALID_PARAMETER;
 	
-	if (IsWild(szSrcSpec) && (*szDestSpec != '\0'))
+	if (IsWild(szSrcSpec) && (*szDestSpec != '\0') && !IsWild(szDestSpec))
 		return FR_INVALID_PARAMETER;
 	
-	fr = f_mount(&fsSrc, szSrcPath, 1);
+	fr = Mount(szSrcPath, 1);
 	if (fr != FR_OK)
 		return fr;
 	
+	if (IsWild(szDestSpec))
+		return RenameWild(szSrcPath, szSrcSpec, szDestPath, szDestSpec);
+	
 	//printf("\nSrcPath='%s', SrcSpec='%s'", szSrcPath, szSrcSpec);
 	
 	fr = f_findfirst(&dir, &fno, szSrcPath, szSrcSpec);
@@ -1032,8 +2744,6 @@ FRESULT Rename(void)
 			fr = f_findnext(&dir, &fno);
 	}
 	
-	f_mount(0, szSrcPath, 0);		// unmount ignoring any errors
-	
 	if (fr != FR_OK)
 		return fr;
 
@@ -1045,15 +2755,18 @@ FRESULT Rename(void)
 	return fr;
 }
 
+void ShowDeleted(const FILINFO * pfno)
+{
+	printf("\n%s/%s", szShowPath, pfno->fname);
+}
+
 FRESULT Delete(void)
 {
-	FATFS fs;
 	FRESULT fr;
 	DIR dir;
-	FILINFO fno;
 	char * szPath;
 	char szFileSpec[MAX_FN];
-	int nFiles;
+	UINT nFiles;
 	
 	nFiles = 0;
 	
@@ -1061,7 +2774,7 @@ FRESULT Delete(void)
 	if (szPath == NULL)
 		return FR_INVALID_PARAMETER;
 
-	fr = f_mount(&fs, szPath, 0);
+	fr = Mount(szPath, 0);
 	if (fr != FR_OK)
 		return fr;
 	
@@ -1072,39 +2785,27 @@ FRESULT Delete(void)
 	if (*szFileSpec == '\0')
 		return FR_INVALID_PARAMETER;
 	
-	// printf("\nf_findfirst() szPath: '%s', szFileSpec: '%s'", szPath, szFileSpec);
+	// printf("\nf_opendir() szPath: '%s', szFileSpec: '%s'", szPath, szFileSpec);
 
-	fr = f_findfirst(&dir, &fno, szPath, szFileSpec);
+	// Matching files and empty directories are deleted in one
+	// pass over the directory
+	fr = f_opendir(&dir, szPath);
 
 	if (fr == FR_OK)
-		printf("\nDeleting...\n");
-
-	while ((fr == FR_OK) && (fno.fname[0]))
 	{
-		char szDelFile[MAX_PATH];
-		
-		strncpy(szDelFile, szPath, sizeof(szDelFile) - 1);
-		strncat(szDelFile, "/", sizeof(szDelFile) - 1);
-		strncat(szDelFile, fno.fname, sizeof(szDelFile) - 1);
-		
-		printf("\n%s", szDelFile);
-		
-		fr = f_unlink(szDelFile);
-		if (fr != FR_OK)
-			return fr;
+		printf("\nDeleting...\n");
 		
-		nFiles++;
+		szShowPath = szPath;
+		fr = f_unlinkfind(&dir, szFileSpec, &nFiles, ShowDeleted);
 		
-		fr = f_findnext(&dir, &fno);
+		f_closedir(&dir);
 	}
 
-	f_mount(0, szPath, 0);		// unmount ignoring any errors
-	
 	if (fr != FR_OK)
 		return fr;
 
 	if (nFiles)
-		printf("\n\n    %i File(s) Deleted", nFiles);
+		printf("\n\n    %u File(s) Deleted", nFiles);
 	else
 		fr = FR_NO_FILE;
 
@@ -1113,7 +2814,6 @@ FRESULT Delete(void)
 
 FRESULT MakeDir(void)
 {
-	FATFS fs;
 	FRESULT fr;
 	char * szPath;
 	
@@ -1121,15 +2821,11 @@ FRESULT MakeDir(void)
 	if (szPath == NULL)
 		return FR_INVALID_PARAMETER;
 
-	fr = f_mount(&fs, szPath, 0);
+	fr = Mount(szPath, 0);
 	if (fr != FR_OK)
 		return fr;
 	
-	fr = f_mkdir(szPath);
-	
-	f_mount(0, szPath, 0);		// unmount ignoring any errors
-	
-	return fr;
+	return f_mkdir(szPath);
 }
 
 FRESULT Format(void)
@@ -1144,6 +2840,7 @@ FRESULT Format(void)
 	};
 	int drv;
 	char * szPath;
+	char szDrive[4];
 	REGS reg;
 	BYTE buf[FF_MAX_SS];
 	
@@ -1155,6 +2852,10 @@ FRESULT Format(void)
 	if (drv == -1)
 		return FR_INVALID_DRIVE;
 	
+	// Command text may be in the memory the overlay is swapped into
+	sprintf(szDrive, "%i:", drv);
+	szPath = szDrive;
+	
 	reg.b.B = 0x17;		// HBIOS Device Function
 	reg.b.C = drv;		// HBIOS Disk Unit Number
 	reg.w.DE = 0;
@@ -1174,44 +2875,216 @@ FRESULT Format(void)
 	else
 		opt.fmt = FM_ANY;				// Hard Disk
 
-	if (opt.fmt & FM_SFD)
-		printf("\nAbout to format Disk Unit #%i."
-			   "\nAll existing data will be destroyed!!!",
-			   FatDrive(szPath));
-	else
-		printf("\nAbout to format FAT Filesystem on Disk Unit #%i."
-			   "\nAll existing FAT partition data will be destroyed!!!",
-			   FatDrive(szPath));
+#if FF_MKFS_OVL
+	// f_mkfs() is in the overlay, entered by the jump at its start.
+	// A mounted volume of the drive may be in the memory the overlay
+	// is swapped into, so it is unregistered while the overlay runs.
+	if ((drv < FF_VOLUMES) && pFatFs[drv])
+		f_mount(NULL, szPath, 0);
+	
+	fr = OvlLoad(OVL_FMT);
+	if (fr != FR_OK)
+		printf("\nCan't load %s", OVL_FMT);
+#else
+	fr = FR_OK;
+#endif
+	
+	if (fr == FR_OK)
+	{
+		if (opt.fmt & FM_SFD)
+			printf("\nAbout to format Disk Unit #%i."
+				   "\nAll existing data will be destroyed!!!",
+				   FatDrive(szPath));
+		else
+			printf("\nAbout to format FAT Filesystem on Disk Unit #%i."
+				   "\nAll existing FAT partition data will be destroyed!!!",
+				   FatDrive(szPath));
+		
+		printf("\n\nContinue (y/n)?");
+		
+		if (Confirm())
+		{
+			printf("\n\nFormatting...");
+			conflush();
+			
+#if FF_MKFS_OVL
+			fr = ((MKFSFUNC)heap_start)(szPath, &opt, buf, sizeof(buf));
+#else
+			fr = f_mkfs(szPath, &opt, buf, sizeof(buf));
+#endif
+			
+			printf("%s", fr == FR_OK ? " Done" : " Failed!");
+		}
+		else
+			printf("\n\nFormat operation aborted.");
+	}
+	
+#if FF_MKFS_OVL
+	// Volume is mounted again when it is next used
+	OvlUnload();
+	if ((drv < FF_VOLUMES) && pFatFs[drv])
+		f_mount(pFatFs[drv], szPath, 0);
+#endif
+	
+	return fr;
+}
+
+FRESULT Command(char * szCmd)
+{
+	char * tok;
+	
+	tok = strtok(szCmd, " ");
+	
+	if (tok == NULL)
+		return FR_OK;
+	
+	strupr(tok);
+	wOpts = 0;
+	
+	if (!strcmp(tok, "DIR"))
+		return Dir();
+	else if (!strcmp(tok, "COPY"))
+		return Copy();
+	else if (!strcmp(tok, "REN"))
+		return Rename();
+	else if (!strcmp(tok, "DEL"))
+		return Delete();
+	else if (!strcmp(tok, "MD"))
+		return MakeDir();
+	else if (!strcmp(tok, "SUM"))
+		return Sum();
+	else if (!strcmp(tok, "FORMAT"))
+		return Format();
+
+	return FR_INVALID_PARAMETER;
+}
+
+FRESULT Script(char * szPath);
+
+FRESULT Batch(char * szList)
+{
+	FRESULT fr;
+	char * szCmd;
+	char * p;
+	char * q;
+	
+	fr = FR_OK;
+	
+	// Commands are separated by ';', the first failing one
+	// ends the batch
+	for (szCmd = szList; (fr == FR_OK) && (szCmd != NULL); szCmd = p)
+	{
+		p = strchr(szCmd, ';');
+		if (p != NULL)
+			*(p++) = '\0';
+		
+		while (*szCmd == ' ')
+			szCmd++;
+		
+		for (q = szCmd + strlen(szCmd); (q > szCmd) && (q[-1] == ' '); q--)
+			q[-1] = '\0';
+		
+		if (*szCmd == '\0')
+			continue;
+		
+		strupr(szCmd);
+		
+		if (*szCmd == '@')
+		{
+			fr = Script(szCmd + 1);
+			continue;
+		}
+		
+		printf("\n\nFAT %s", szCmd);
+		
+		fr = Command(szCmd);
+	}
+	
+	return fr;
+}
+
+FRESULT Script(char * szPath)
+{
+	FRESULT fr;
+	FILE file;
+	char * szText;
+	char * p;
+	UINT nMax, br;
+	
+	// Scripts may not run other scripts
+	if (bScript)
+		return FR_INVALID_PARAMETER;
 	
-	printf("\n\nContinue (y/n)?");
+	memset(&file, 0, sizeof(file));
+	file.fstyp = IsFatPath(szPath) ? FS_FAT : FS_CPM;
 	
-	if (!Confirm()) {
-		printf("\n\nFormat operation aborted.");
-		return 0;
+	if (file.fstyp == FS_FAT)
+	{
+		fr = Mount(szPath, 0);
+		if (fr != FR_OK)
+			return fr;
 	}
 	
-	printf("\n\nFormatting...");
+	// Script text stays in free TPA while it runs
+	szText = (char *)pTpaFree;
+	nMax = XferSize();
+	if (nMax <= RECLEN)
+		return FR_NOT_ENOUGH_CORE;
+	nMax -= RECLEN;
+	
+	fr = Open(&file, NULL, szPath, FA_READ);
+	if (fr != FR_OK)
+		return fr;
+	
+	br = 0;
+	fr = Read(&file, (BYTE *)szText, nMax, &br);
+	Close(&file);
 	
-	fr = f_mkfs(szPath, &opt, buf, sizeof(buf));
+	if (fr != FR_OK)
+		return fr;
+	
+	if (br >= nMax)
+		return FR_NOT_ENOUGH_CORE;
+	
+	szText[br] = '\0';
+	p = strchr(szText, 0x1A);	// CP/M end of text
+	if (p != NULL)
+		*p = '\0';
+	
+	TpaAlloc(br + 1);
+	
+	bScript = TRUE;
+	
+	// One or more commands per line
+	for (p = szText; (fr == FR_OK) && (*p != '\0'); p = szText)
+	{
+		szText = p + strcspn(p, "\r\n");
+		if (*szText != '\0')
+			*(szText++) = '\0';
+		
+		fr = Batch(p);
+	}
 	
-	printf("%s", fr == FR_OK ? " Done" : " Failed!");
+	bScript = FALSE;
 	
 	return fr;
 }
 
 int main(int argc, char * argv[])
 {
-	char * tok;
+	char * p;
 	FRESULT fr;
 
 	bios_id = chkbios();
+	pTpaFree = heap_start;
 
 	if (argc != 2)
 		return Usage();
 	
-	tok = strtok(argv[1], " ");
+	for (p = argv[1]; *p == ' '; p++)
+		;
 	
-	if (tok == NULL)
+	if (*p == '\0')
 		return Usage();
 
 	if (bios_id != BIOS_WBW)
@@ -1220,22 +3093,14 @@ int main(int argc, char * argv[])
 		return Error(FR_INT_ERR);
 	}
 
-	strupr(tok);
-	
-	if (!strcmp(tok, "DIR"))
-		fr = Dir();
-	else if (!strcmp(tok, "COPY"))
-		fr = Copy();
-	else if (!strcmp(tok, "REN"))
-		fr = Rename();
-	else if (!strcmp(tok, "DEL"))
-		fr = Delete();
-	else if (!strcmp(tok, "MD"))
-		fr = MakeDir();
-	else if (!strcmp(tok, "FORMAT"))
-		fr = Format();
+	// A script or a list of commands runs as a batch in this
+	// one process, with the FAT volumes staying mounted
+	if ((*p == '@') || (strchr(p, ';') != NULL))
+	{
+		fr = Batch(p);
+	}
 	else
-		fr = FR_INVALID_PARAMETER;
+		fr = Command(p);
 	
 	if (fr != FR_OK)
 		return Error(fr);
@@ -0,0 +1,162 @@
+#--------------------------------------------------------------------------
+#  fatpack.ps1 - Build the compressed FAT.COM
+#
+#  Usage: fatpack.ps1 <stub> <image> <output>
+#
+#  Packs <image> (the plain FAT.COM) and appends it to <stub> (the
+#  startup stub built from fatunz.s) to make <output>.  See fatunz.s
+#  for the format of the packed data.  If packing does not save
+#  anything, <image> is written unchanged.
+#--------------------------------------------------------------------------
+
+param([string]$Stub, [string]$Image, [string]$Out)
+
+$ErrorActionPreference = "Stop"
+[Environment]::CurrentDirectory = (Get-Location).Path
+
+Add-Type -TypeDefinition @"
+using System.Collections.Generic;
+
+public static class FatPack
+{
+	const int HBITS = 12;		// Hash table size (bits)
+	const int WSIZE = 65535;	// Largest offset
+	const int MINLEN = 3;		// Shortest match
+	const int MAXLEN = 66;		// Longest match
+	const int CHAIN = 256;		// Match candidates tried per position
+
+	static byte[] src;
+	static int[] head, prev;
+	static int ins;			// Next position to enter in hash chains
+
+	// Largest lead of unpacked over packed bytes at any item end.
+	// Packed data placed this far above the unpacked image is
+	// never overwritten before the decoder has read it.
+	public static int Slack;
+
+	static void Track(List<byte> dst, int p)
+	{
+		if (p - dst.Count > Slack) Slack = p - dst.Count;
+	}
+
+	static int Hash(int p)
+	{
+		return ((src[p] << 8) ^ (src[p + 1] << 4) ^ src[p + 2]) & ((1 << HBITS) - 1);
+	}
+
+	// Bytes saved by a match, less than 1 if not worth it
+	static int Gain(int len, int off)
+	{
+		return len - (off <= 256 ? 2 : 3);
+	}
+
+	// Find the best earlier match for position p
+	static int Find(int p, out int off)
+	{
+		int best = 0, tries = 0, max, c, n;
+
+		off = 0;
+		if (p + MINLEN > src.Length) return 0;
+		for (; ins < p; ins++) {
+			if (ins + MINLEN > src.Length) continue;
+			int h = Hash(ins);
+			prev[ins] = head[h];
+			head[h] = ins;
+		}
+		max = src.Length - p;
+		if (max > MAXLEN) max = MAXLEN;
+		for (c = head[Hash(p)]; c >= 0 && p - c <= WSIZE && tries < CHAIN; c = prev[c], tries++) {
+			n = 0;
+			while (n < max && src[c + n] == src[p + n]) n++;
+			if (n >= MINLEN && (best == 0 || Gain(n, p - c) > Gain(best, off))) {
+				best = n;
+				off = p - c;
+			}
+		}
+		if (best != 0 && Gain(best, off) < 1) best = 0;
+		return best;
+	}
+
+	static void Literals(List<byte> dst, int p, int n)
+	{
+		while (n > 0) {
+			int k = n > 128 ? 128 : n;
+			dst.Add((byte)(k - 1));
+			for (int i = 0; i < k; i++) dst.Add(src[p + i]);
+			p += k;
+			n -= k;
+			Track(dst, p);
+		}
+	}
+
+	public static byte[] Pack(byte[] data)
+	{
+		List<byte> dst = new List<byte>();
+		int p = 0, lit = 0, len, off, len2, off2;
+
+		src = data;
+		head = new int[1 << HBITS];
+		prev = new int[data.Length];
+		for (int i = 0; i < head.Length; i++) head[i] = -1;
+		ins = 0;
+		Slack = 0;
+
+		while (p < src.Length) {
+			len = Find(p, out off);
+			if (len > 0) {
+				// Lazy match: prefer a better match one byte later
+				len2 = Find(p + 1, out off2);
+				if (len2 > 0 && Gain(len2, off2) > Gain(len, off)) len = 0;
+			}
+			if (len == 0) {
+				p++;
+				continue;
+			}
+			Literals(dst, lit, p - lit);
+			if (off <= 256) {
+				dst.Add((byte)(0x80 | (len - MINLEN)));
+				dst.Add((byte)(off - 1));
+			} else {
+				dst.Add((byte)(0xC0 | (len - MINLEN)));
+				dst.Add((byte)(off & 0xFF));
+				dst.Add((byte)(off >> 8));
+			}
+			p += len;
+			lit = p;
+			Track(dst, p);
+		}
+		Literals(dst, lit, p - lit);
+		dst.Add(0xC0);			// End of data
+		dst.Add(0x00);
+		dst.Add(0x00);
+		Track(dst, p);
+		return dst.ToArray();
+	}
+}
+"@
+
+$stubdat = [IO.File]::ReadAllBytes($Stub)
+$imgdat = [IO.File]::ReadAllBytes($Image)
+$packdat = [FatPack]::Pack($imgdat)
+
+if ($stubdat.Length + $packdat.Length -ge $imgdat.Length) {
+	Write-Host "$Image not packed"
+	[IO.File]::WriteAllBytes($Out, $imgdat)
+	exit 0
+}
+
+# Packed data is moved up at startup to end at pend, which must
+# not be below where it is loaded
+$pend = 0x100 + [FatPack]::Slack + $packdat.Length
+if ($pend -lt 0x100 + $stubdat.Length + $packdat.Length) {
+	$pend = 0x100 + $stubdat.Length + $packdat.Length
+}
+
+# plen and pend follow the jump at the start of the stub
+$stubdat[3] = $packdat.Length -band 0xFF
+$stubdat[4] = $packdat.Length -shr 8
+$stubdat[5] = $pend -band 0xFF
+$stubdat[6] = $pend -shr 8
+
+[IO.File]::WriteAllBytes($Out, [byte[]]($stubdat + $packdat))
+Write-Host ("{0} packed from {1} to {2} bytes" -f $Image, $imgdat.Length, ($stubdat.Length + $packdat.Length))
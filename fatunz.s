@@ -0,0 +1,121 @@
+;--------------------------------------------------------------------------
+;  fatunz.s - Startup stub of the compressed FAT.COM
+;
+;  fatpack.ps1 appends the packed image of FAT.COM to this stub and
+;  fills in plen and pend.  At startup the decoder is copied to the
+;  page below the stack and the packed data is moved up so that it
+;  ends at pend.  The decoder then unpacks the image to 0x0100 and
+;  jumps to it, so the program runs exactly as the unpacked FAT.COM
+;  would.  fatpack.ps1 places pend just far enough above the end of
+;  the unpacked image that unpacking never overwrites packed data it
+;  has not read yet.
+;
+;  Packed data is a sequence of items, each starting with a control
+;  byte c:
+;
+;    0x00-0x7F	c+1 literal bytes follow
+;    0x80-0xBF	copy (c & 0x3F)+3 bytes from offset n+1 back,
+;		one byte n follows
+;    0xC0-0xFF	copy (c & 0x3F)+3 bytes from offset n back,
+;		two bytes n (LSB first) follow, n = 0 ends the data
+;--------------------------------------------------------------------------
+
+	.module fatunz
+
+	.area	_CODE
+	jp	unz
+plen:	.dw	0		; length of packed data (set by fatpack)
+pend:	.dw	0		; end of moved packed data (set by fatpack)
+
+unz:
+	ld	hl, (#0x0006)	; get BDOS call vector
+	ld	l, #0x00	; throw away LSB
+	ld	sp, hl		; stack directly below BDOS as in ucrt0
+	dec	h		; hl = decoder home, bottom of stack page
+	ld	de, (pend)
+	push	hl
+	or	a
+	sbc	hl, de		; packed data must end below decoder
+	pop	hl
+	jr	c, nomem
+
+	push	hl		; return to moved decoder
+	ex	de, hl
+	ld	hl, #dec
+	ld	bc, #dend-dec
+	ldir
+
+	ld	hl, (plen)
+	ld	b, h
+	ld	c, l		; bc = length of packed data
+	ld	de, #dend-1
+	add	hl, de		; hl = last byte of packed data
+	ld	de, (pend)
+	dec	de		; de = last byte of moved packed data
+	lddr
+	ret
+
+nomem:
+	ld	de, #nomsg
+	ld	c, #9		; BDOS print string
+	call	#0x0005
+	jp	0		; back to CP/M
+
+nomsg:	.ascii	"Not enough memory"
+	.db	13, 10, '$
+
+	;; The decoder runs from wherever unz copied it, so it
+	;; uses relative jumps only.  On entry de is one below the
+	;; moved packed data (as left by lddr).
+dec:
+	ex	de, hl
+	inc	hl		; hl = packed data
+	ld	de, #0x0100	; de = unpacked image
+dloop:
+	ld	a, (hl)		; control byte
+	inc	hl
+	cp	#0x80
+	jr	nc, dmatch
+	ld	c, a		; literal bytes
+	ld	b, #0
+	inc	c
+	ldir
+	jr	dloop
+dmatch:
+	ld	c, a
+	ld	a, (hl)		; offset LSB
+	inc	hl
+	push	hl
+	bit	6, c
+	jr	nz, dlong
+	ld	l, a		; one byte offset
+	ld	h, #0
+	inc	hl
+	jr	dcopy
+dlong:
+	ld	h, (hl)		; offset MSB
+	ld	l, a
+	ex	(sp), hl
+	inc	hl
+	ex	(sp), hl
+	ld	a, h
+	or	l
+	jr	z, ddone
+dcopy:
+	ld	a, c
+	and	#0x3F
+	add	a, #3
+	ld	c, a
+	ld	b, #0
+	push	de
+	ex	de, hl
+	or	a
+	sbc	hl, de		; hl = out - offset
+	pop	de
+	ldir
+	pop	hl
+	jr	dloop
+ddone:
+	pop	hl
+	jp	0x0100		; run unpacked FAT.COM
+dend:
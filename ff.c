@@ -22,6 +22,9 @@
 #include <string.h>
 #include "ff.h"			/* Declarations of FatFs API */
 #include "diskio.h"		/* Declarations of device I/O functions */
+// WBW (start)
+#include "ffz80.h"		/* Z80 helpers for byte order and block moves */
+// WBW (end)
 
 
 /*--------------------------------------------------------------------------
@@ -261,9 +264,27 @@
 #endif
 #if FF_MAX_SS == FF_MIN_SS
 #define SS(fs)	((UINT)FF_MAX_SS)	/* Fixed sector size */
+// WBW (start)
+#if FF_MAX_SS == 512
+#define SS_SH(fs)	9				/* Fixed sector size shift */
+#elif FF_MAX_SS == 1024
+#define SS_SH(fs)	10
+#elif FF_MAX_SS == 2048
+#define SS_SH(fs)	11
+#else
+#define SS_SH(fs)	12
+#endif
+// WBW (end)
 #else
 #define SS(fs)	((fs)->ssize)	/* Variable sector size */
+// WBW (start)
+#define SS_SH(fs)	((fs)->ssize_sh)	/* Variable sector size shift */
+// WBW (end)
 #endif
+// WBW (start)
+#define SS_OFS(fs, ofs)	((UINT)(ofs) & (SS(fs) - 1))		/* Byte offset in the sector */
+#define CL_SH(fs)	(SS_SH(fs) + (fs)->csize_sh)		/* Cluster size shift in bytes */
+// WBW (end)
 
 
 /* Timestamp */
@@ -461,6 +482,9 @@ typedef struct {
 #if FF_VOLUMES < 1 || FF_VOLUMES > 10
 #error Wrong FF_VOLUMES setting
 #endif
+// WBW (start)
+#if !FF_MKFS_PART	/* Not in f_mkfs() built on its own (ffmkfs.c) */
+// WBW (end)
 static FATFS *FatFs[FF_VOLUMES];	/* Pointer to the filesystem objects (logical drives) */
 static WORD Fsid;					/* Filesystem mount ID */
 
@@ -474,6 +498,9 @@ static FILESEM Files[FF_FS_LOCK];	/* Open object lock semaphores */
 static BYTE SysLock;				/* System lock flag (0:no mutex, 1:unlocked, 2:locked) */
 #endif
 #endif
+// WBW (start)
+#endif	/* !FF_MKFS_PART */
+// WBW (end)
 
 #if FF_STR_VOLUME_ID
 #ifdef FF_VOLUME_STRS
@@ -563,6 +590,9 @@ static WCHAR LfnBuf[FF_MAX_LFN + 1];		/* LFN working buffer */
 /* Code conversion tables         */
 /*--------------------------------*/
 
+// WBW (start)
+#if !FF_MKFS_PART
+// WBW (end)
 #if FF_CODE_PAGE == 0	/* Run-time code page configuration */
 #define CODEPAGE CodePage
 static WORD CodePage;	/* Current code page */
@@ -600,6 +630,9 @@ static const BYTE ExCvt[] = MKCVTBL(TBL_CT, FF_CODE_PAGE);
 static const BYTE DbcTbl[] = MKCVTBL(TBL_DC, FF_CODE_PAGE);
 
 #endif
+// WBW (start)
+#endif	/* !FF_MKFS_PART */
+// WBW (end)
 
 
 
@@ -615,6 +648,12 @@ static const BYTE DbcTbl[] = MKCVTBL(TBL_DC, FF_CODE_PAGE);
 /* Load/Store multi-byte word in the FAT structure                       */
 /*-----------------------------------------------------------------------*/
 
+// WBW (start)
+#if FF_Z80_ASM
+#define ld_word(ptr) ff_ld_word(ptr)
+#define ld_dword(ptr) ff_ld_dword(ptr)
+#else
+// WBW (end)
 static WORD ld_word (const BYTE* ptr)	/*	 Load a 2-byte little-endian word */
 {
 	WORD rv;
@@ -634,6 +673,9 @@ static DWORD ld_dword (const BYTE* ptr)	/* Load a 4-byte little-endian word */
 	rv = rv << 8 | ptr[0];
 	return rv;
 }
+// WBW (start)
+#endif
+// WBW (end)
 
 #if FF_FS_EXFAT
 static QWORD ld_qword (const BYTE* ptr)	/* Load an 8-byte little-endian word */
@@ -653,6 +695,12 @@ static QWORD ld_qword (const BYTE* ptr)	/* Load an 8-byte little-endian word */
 #endif
 
 #if !FF_FS_READONLY
+// WBW (start)
+#if FF_Z80_ASM
+#define st_word(ptr, val) ff_st_word(ptr, val)
+#define st_dword(ptr, val) ff_st_dword(ptr, val)
+#else
+// WBW (end)
 static void st_word (BYTE* ptr, WORD val)	/* Store a 2-byte word in little-endian */
 {
 	*ptr++ = (BYTE)val; val >>= 8;
@@ -666,6 +714,9 @@ static void st_dword (BYTE* ptr, DWORD val)	/* Store a 4-byte word in little-end
 	*ptr++ = (BYTE)val; val >>= 8;
 	*ptr++ = (BYTE)val;
 }
+// WBW (start)
+#endif
+// WBW (end)
 
 #if FF_FS_EXFAT
 static void st_qword (BYTE* ptr, QWORD val)	/* Store an 8-byte word in little-endian */
@@ -684,6 +735,9 @@ static void st_qword (BYTE* ptr, QWORD val)	/* Store an 8-byte word in little-en
 
 
 
+// WBW (start)
+#if !FF_MKFS_PART	/* f_mkfs() built on its own only needs the functions above */
+// WBW (end)
 /*-----------------------------------------------------------------------*/
 /* String functions                                                      */
 /*-----------------------------------------------------------------------*/
@@ -1137,6 +1191,78 @@ static FRESULT sync_fs (	/* Returns FR_OK or FR_DISK_ERR */
 
 
 
+#if FF_FS_FILPOOL
+/*-----------------------------------------------------------------------*/
+/* Get a sector buffer from the pool of the volume for the file          */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT get_fbuf (	/* Returns FR_OK or FR_DISK_ERR */
+	FIL* fp,		/* File object to get the sector buffer */
+	int keep		/* 1:buf[] needs to hold fp->sect, 0:Caller loads buf[] by itself */
+)
+{
+	FATFS *fs = fp->obj.fs;
+	FIL *ow;
+	UINT i, n;
+
+
+	if (!fp->buf) {		/* The file has no buffer (not given yet or taken by another file) */
+		for (n = i = 0; i < FF_FS_FILPOOL; i++) {	/* Find a free or the least recently used buffer */
+			if (!fs->pown[i]) {
+				n = i; break;
+			}
+			if ((WORD)(fs->ptick - fs->puse[i]) > (WORD)(fs->ptick - fs->puse[n])) n = i;
+		}
+		ow = fs->pown[n];
+		if (ow && ow->buf == fs->pbuf[n]) {	/* Take the buffer from the current owner */
+#if !FF_FS_READONLY
+			if (ow->flag & FA_DIRTY) {		/* Write-back its dirty sector */
+				if (disk_write(fs->pdrv, ow->buf, ow->sect, 1) != RES_OK) return FR_DISK_ERR;
+				ow->flag &= (BYTE)~FA_DIRTY;
+			}
+#endif
+			ow->buf = 0;					/* The owner reloads its sector when it needs it again */
+		}
+		fs->pown[n] = fp;
+		fp->buf = fs->pbuf[n];
+		if (keep && fp->sect != 0 && disk_read(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) {
+			fp->sect = 0;
+			return FR_DISK_ERR;
+		}
+	} else {
+		for (n = 0; fs->pbuf[n] != fp->buf; n++) ;
+	}
+	fs->puse[n] = ++fs->ptick;	/* Mark the buffer most recently used */
+
+	return FR_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Return the sector buffer of the file to the pool                      */
+/*-----------------------------------------------------------------------*/
+
+static void put_fbuf (
+	FIL* fp		/* File object to release the sector buffer */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < FF_FS_FILPOOL; i++) {
+		if (fp->obj.fs->pown[i] == fp) fp->obj.fs->pown[i] = 0;
+	}
+	fp->buf = 0;
+}
+
+#define GET_FBUF(fp, keep)	get_fbuf(fp, keep)
+#else
+#define GET_FBUF(fp, keep)	FR_OK
+#endif
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get physical sector number from cluster number                        */
 /*-----------------------------------------------------------------------*/
@@ -1148,12 +1274,169 @@ static LBA_t clst2sect (	/* !=0:Sector number, 0:Failed (invalid cluster#) */
 {
 	clst -= 2;		/* Cluster number is origin from 2 */
 	if (clst >= fs->n_fatent - 2) return 0;		/* Is it invalid cluster number? */
-	return fs->database + (LBA_t)fs->csize * clst;	/* Start sector number of the cluster */
+	// WBW (start)
+	//return fs->database + (LBA_t)fs->csize * clst;	/* Start sector number of the cluster */
+	return fs->database + ((LBA_t)clst << fs->csize_sh);	/* Start sector number of the cluster */
+	// WBW (end)
 }
 
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT access - Per FAT sub-type entry accessors                         */
+/*-----------------------------------------------------------------------*/
+// WBW (start)
+/* The cluster number has been range checked by get_fat()/put_fat(). A
+/  volume binds the accessor set of its sub-type at mount. When only one
+/  sub-type is enabled by FF_FS_FATTYPES, it is called directly instead. */
+
+#if FF_FS_FATTYPES & 1
+static DWORD get_fat12 (	/* 0xFFFFFFFF:Disk error, 2..0xFFF:Cluster status */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Cluster number to get the value */
+)
+{
+	UINT wc, bc;
+
+
+	bc = (UINT)clst; bc += bc / 2;
+	if (move_window(fs, fs->fatbase + (bc >> SS_SH(fs))) != FR_OK) return 0xFFFFFFFF;
+	wc = fs->win[SS_OFS(fs, bc++)];		/* Get 1st byte of the entry */
+	if (move_window(fs, fs->fatbase + (bc >> SS_SH(fs))) != FR_OK) return 0xFFFFFFFF;
+	wc |= fs->win[SS_OFS(fs, bc)] << 8;	/* Merge 2nd byte of the entry */
+	return (clst & 1) ? (wc >> 4) : (wc & 0xFFF);	/* Adjust bit position */
+}
+#endif
+
+#if FF_FS_FATTYPES & 2
+static DWORD get_fat16 (	/* 0xFFFFFFFF:Disk error, 2..0xFFFF:Cluster status */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Cluster number to get the value */
+)
+{
+	if (move_window(fs, fs->fatbase + (clst >> (SS_SH(fs) - 1))) != FR_OK) return 0xFFFFFFFF;
+	return ld_word(fs->win + SS_OFS(fs, clst * 2));		/* Simple WORD array */
+}
+#endif
+
+#if FF_FS_FATTYPES & 4
+static DWORD get_fat32 (	/* 0xFFFFFFFF:Disk error, 2..0x0FFFFFFF:Cluster status */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst		/* Cluster number to get the value */
+)
+{
+	if (move_window(fs, fs->fatbase + (clst >> (SS_SH(fs) - 2))) != FR_OK) return 0xFFFFFFFF;
+	return ld_dword(fs->win + SS_OFS(fs, clst * 4)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
+}
+#endif
+
+#if !FF_FS_READONLY
+#if FF_FS_FATTYPES & 1
+static FRESULT put_fat12 (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* FAT index number (cluster number) to be changed */
+	DWORD val		/* New value to be set to the entry */
+)
+{
+	UINT bc;
+	BYTE *p;
+	FRESULT res;
+
+
+	bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
+	res = move_window(fs, fs->fatbase + (bc >> SS_SH(fs)));
+	if (res != FR_OK) return res;
+	p = fs->win + SS_OFS(fs, bc++);
+	*p = (clst & 1) ? ((*p & 0x0F) | ((BYTE)val << 4)) : (BYTE)val;	/* Update 1st byte */
+	fs->wflag = 1;
+	res = move_window(fs, fs->fatbase + (bc >> SS_SH(fs)));
+	if (res != FR_OK) return res;
+	p = fs->win + SS_OFS(fs, bc);
+	*p = (clst & 1) ? (BYTE)(val >> 4) : ((*p & 0xF0) | ((BYTE)(val >> 8) & 0x0F));	/* Update 2nd byte */
+	fs->wflag = 1;
+	return FR_OK;
+}
+#endif
+
+#if FF_FS_FATTYPES & 2
+static FRESULT put_fat16 (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* FAT index number (cluster number) to be changed */
+	DWORD val		/* New value to be set to the entry */
+)
+{
+	FRESULT res;
+
+
+	res = move_window(fs, fs->fatbase + (clst >> (SS_SH(fs) - 1)));
+	if (res != FR_OK) return res;
+	st_word(fs->win + SS_OFS(fs, clst * 2), (WORD)val);	/* Simple WORD array */
+	fs->wflag = 1;
+	return FR_OK;
+}
+#endif
+
+#if FF_FS_FATTYPES & 4
+static FRESULT put_fat32 (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* Filesystem object */
+	DWORD clst,		/* FAT index number (cluster number) to be changed */
+	DWORD val		/* New value to be set to the entry */
+)
+{
+	FRESULT res;
+
+
+	res = move_window(fs, fs->fatbase + (clst >> (SS_SH(fs) - 2)));
+	if (res != FR_OK) return res;
+	val = (val & 0x0FFFFFFF) | (ld_dword(fs->win + SS_OFS(fs, clst * 4)) & 0xF0000000);	/* Preserve upper 4 bits */
+	st_dword(fs->win + SS_OFS(fs, clst * 4), val);
+	fs->wflag = 1;
+	return FR_OK;
+}
+#endif
+#endif	/* !FF_FS_READONLY */
+
+#if FF_FAT_MULTI
+typedef struct {
+	DWORD (*get)(FATFS* fs, DWORD clst);				/* Read an FAT entry */
+#if !FF_FS_READONLY
+	FRESULT (*put)(FATFS* fs, DWORD clst, DWORD val);	/* Change an FAT entry */
+#endif
+} FATACC;
+
+#if FF_FS_READONLY
+#define FATACC_ENTRY(n)	{get_fat##n}
+#else
+#define FATACC_ENTRY(n)	{get_fat##n, put_fat##n}
+#endif
+#if FF_FS_FATTYPES & 1
+static const FATACC FatAcc12 = FATACC_ENTRY(12);
+#endif
+#if FF_FS_FATTYPES & 2
+static const FATACC FatAcc16 = FATACC_ENTRY(16);
+#endif
+#if FF_FS_FATTYPES & 4
+static const FATACC FatAcc32 = FATACC_ENTRY(32);
+#endif
+
+#define GET_FAT(fs, clst)		(((const FATACC*)(fs)->facc)->get((fs), (clst)))
+#define PUT_FAT(fs, clst, val)	(((const FATACC*)(fs)->facc)->put((fs), (clst), (val)))
+#elif FF_FS_FATTYPES == 1
+#define GET_FAT(fs, clst)		get_fat12((fs), (clst))
+#define PUT_FAT(fs, clst, val)	put_fat12((fs), (clst), (val))
+#elif FF_FS_FATTYPES == 2
+#define GET_FAT(fs, clst)		get_fat16((fs), (clst))
+#define PUT_FAT(fs, clst, val)	put_fat16((fs), (clst), (val))
+#else
+#define GET_FAT(fs, clst)		get_fat32((fs), (clst))
+#define PUT_FAT(fs, clst, val)	put_fat32((fs), (clst), (val))
+#endif
+// WBW (end)
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT access - Read value of an FAT entry                               */
 /*-----------------------------------------------------------------------*/
@@ -1163,7 +1446,6 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 	DWORD clst		/* Cluster number to get the value */
 )
 {
-	UINT wc, bc;
 	DWORD val;
 	FATFS *fs = obj->fs;
 
@@ -1172,56 +1454,40 @@ static DWORD get_fat (		/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x7FFFFFF
 		val = 1;	/* Internal error */
 
 	} else {
-		val = 0xFFFFFFFF;	/* Default value falls on disk error */
-
-		switch (fs->fs_type) {
-		case FS_FAT12 :
-			bc = (UINT)clst; bc += bc / 2;
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc = fs->win[bc++ % SS(fs)];		/* Get 1st byte of the entry */
-			if (move_window(fs, fs->fatbase + (bc / SS(fs))) != FR_OK) break;
-			wc |= fs->win[bc % SS(fs)] << 8;	/* Merge 2nd byte of the entry */
-			val = (clst & 1) ? (wc >> 4) : (wc & 0xFFF);	/* Adjust bit position */
-			break;
-
-		case FS_FAT16 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 2))) != FR_OK) break;
-			val = ld_word(fs->win + clst * 2 % SS(fs));		/* Simple WORD array */
-			break;
-
-		case FS_FAT32 :
-			if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-			val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x0FFFFFFF;	/* Simple DWORD array but mask out upper 4 bits */
-			break;
 #if FF_FS_EXFAT
-		case FS_EXFAT :
-			if ((obj->objsize != 0 && obj->sclust != 0) || obj->stat == 0) {	/* Object except root dir must have valid data length */
-				DWORD cofs = clst - obj->sclust;	/* Offset from start cluster */
-				DWORD clen = (DWORD)((LBA_t)((obj->objsize - 1) / SS(fs)) / fs->csize);	/* Number of clusters - 1 */
+		if (fs->fs_type == FS_EXFAT) {
+			val = 0xFFFFFFFF;	/* Default value falls on disk error */
+			do {
+				if ((obj->objsize != 0 && obj->sclust != 0) || obj->stat == 0) {	/* Object except root dir must have valid data length */
+					DWORD cofs = clst - obj->sclust;	/* Offset from start cluster */
+					DWORD clen = (DWORD)((LBA_t)((obj->objsize - 1) / SS(fs)) / fs->csize);	/* Number of clusters - 1 */
 
-				if (obj->stat == 2 && cofs <= clen) {	/* Is it a contiguous chain? */
-					val = (cofs == clen) ? 0x7FFFFFFF : clst + 1;	/* No data on the FAT, generate the value */
-					break;
-				}
-				if (obj->stat == 3 && cofs < obj->n_cont) {	/* Is it in the 1st fragment? */
-					val = clst + 1; 	/* Generate the value */
-					break;
-				}
-				if (obj->stat != 2) {	/* Get value from FAT if FAT chain is valid */
-					if (obj->n_frag != 0) {	/* Is it on the growing edge? */
-						val = 0x7FFFFFFF;	/* Generate EOC */
-					} else {
-						if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
-						val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x7FFFFFFF;
+					if (obj->stat == 2 && cofs <= clen) {	/* Is it a contiguous chain? */
+						val = (cofs == clen) ? 0x7FFFFFFF : clst + 1;	/* No data on the FAT, generate the value */
+						break;
+					}
+					if (obj->stat == 3 && cofs < obj->n_cont) {	/* Is it in the 1st fragment? */
+						val = clst + 1; 	/* Generate the value */
+						break;
+					}
+					if (obj->stat != 2) {	/* Get value from FAT if FAT chain is valid */
+						if (obj->n_frag != 0) {	/* Is it on the growing edge? */
+							val = 0x7FFFFFFF;	/* Generate EOC */
+						} else {
+							if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4))) != FR_OK) break;
+							val = ld_dword(fs->win + clst * 4 % SS(fs)) & 0x7FFFFFFF;
+						}
+						break;
 					}
-					break;
 				}
-			}
-			val = 1;	/* Internal error */
-			break;
+				val = 1;	/* Internal error */
+			} while (0);
+		} else
 #endif
-		default:
-			val = 1;	/* Internal error */
+		{
+			// WBW (start)
+			val = GET_FAT(fs, clst);	/* FAT12/16/32 accessor bound at mount */
+			// WBW (end)
 		}
 	}
 
@@ -1242,46 +1508,23 @@ static FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 	DWORD val		/* New value to be set to the entry */
 )
 {
-	UINT bc;
-	BYTE *p;
 	FRESULT res = FR_INT_ERR;
 
 
 	if (clst >= 2 && clst < fs->n_fatent) {	/* Check if in valid range */
-		switch (fs->fs_type) {
-		case FS_FAT12:
-			bc = (UINT)clst; bc += bc / 2;	/* bc: byte offset of the entry */
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
-			p = fs->win + bc++ % SS(fs);
-			*p = (clst & 1) ? ((*p & 0x0F) | ((BYTE)val << 4)) : (BYTE)val;	/* Update 1st byte */
-			fs->wflag = 1;
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
-			if (res != FR_OK) break;
-			p = fs->win + bc % SS(fs);
-			*p = (clst & 1) ? (BYTE)(val >> 4) : ((*p & 0xF0) | ((BYTE)(val >> 8) & 0x0F));	/* Update 2nd byte */
-			fs->wflag = 1;
-			break;
-
-		case FS_FAT16:
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 2)));
-			if (res != FR_OK) break;
-			st_word(fs->win + clst * 2 % SS(fs), (WORD)val);	/* Simple WORD array */
-			fs->wflag = 1;
-			break;
-
-		case FS_FAT32:
 #if FF_FS_EXFAT
-		case FS_EXFAT:
-#endif
+		if (fs->fs_type == FS_EXFAT) {
 			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 4)));
-			if (res != FR_OK) break;
-			if (!FF_FS_EXFAT || fs->fs_type != FS_EXFAT) {
-				val = (val & 0x0FFFFFFF) | (ld_dword(fs->win + clst * 4 % SS(fs)) & 0xF0000000);
+			if (res == FR_OK) {
+				st_dword(fs->win + clst * 4 % SS(fs), val);
+				fs->wflag = 1;
 			}
-			st_dword(fs->win + clst * 4 % SS(fs), val);
-			fs->wflag = 1;
-			break;
+		} else
+#endif
+		{
+			// WBW (start)
+			res = PUT_FAT(fs, clst, val);	/* FAT12/16/32 accessor bound at mount */
+			// WBW (end)
 		}
 	}
 	return res;
@@ -1635,7 +1878,7 @@ static DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 	tbl = fp->cltbl + 1;	/* Top of CLMT */
-	cl = (DWORD)(ofs / SS(fs) / fs->csize);	/* Cluster order from top of the file */
+	cl = (DWORD)(ofs >> CL_SH(fs));	/* Cluster order from top of the file */
 	for (;;) {
 		ncl = *tbl++;			/* Number of cluters in the fragment */
 		if (ncl == 0) return 0;	/* End of table? (error) */
@@ -1668,7 +1911,7 @@ static FRESULT dir_clear (	/* Returns FR_OK or FR_DISK_ERR */
 	if (sync_window(fs) != FR_OK) return FR_DISK_ERR;	/* Flush disk access window */
 	sect = clst2sect(fs, clst);		/* Top of the cluster */
 	fs->winsect = sect;				/* Set window to top of the cluster */
-	memset(fs->win, 0, sizeof fs->win);	/* Clear window buffer */
+	ff_memset(fs->win, 0, sizeof fs->win);	/* Clear window buffer */
 #if FF_USE_LFN == 3		/* Quick table clear by using multi-secter write */
 	/* Allocate a temporary buffer */
 	for (szb = ((DWORD)fs->csize * SS(fs) >= MAX_MALLOC) ? MAX_MALLOC : fs->csize * SS(fs), ibuf = 0; szb > SS(fs) && (ibuf = ff_memalloc(szb)) == 0; szb /= 2) ;
@@ -1729,8 +1972,8 @@ static FRESULT dir_sdi (	/* FR_OK(0):succeeded, !=0:error */
 	}
 	dp->clust = clst;					/* Current cluster# */
 	if (dp->sect == 0) return FR_INT_ERR;
-	dp->sect += ofs / SS(fs);			/* Sector# of the directory entry */
-	dp->dir = fs->win + (ofs % SS(fs));	/* Pointer to the entry in the win[] */
+	dp->sect += ofs >> SS_SH(fs);			/* Sector# of the directory entry */
+	dp->dir = fs->win + SS_OFS(fs, ofs);	/* Pointer to the entry in the win[] */
 
 	return FR_OK;
 }
@@ -1755,7 +1998,7 @@ static FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DEN
 	if (ofs >= (DWORD)((FF_FS_EXFAT && fs->fs_type == FS_EXFAT) ? MAX_DIR_EX : MAX_DIR)) dp->sect = 0;	/* Disable it if the offset reached the max value */
 	if (dp->sect == 0) return FR_NO_FILE;	/* Report EOT if it has been disabled */
 
-	if (ofs % SS(fs) == 0) {	/* Sector changed? */
+	if (SS_OFS(fs, ofs) == 0) {	/* Sector changed? */
 		dp->sect++;				/* Next sector */
 
 		if (dp->clust == 0) {	/* Static table */
@@ -1764,7 +2007,7 @@ static FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DEN
 			}
 		}
 		else {					/* Dynamic table */
-			if ((ofs / SS(fs) & (fs->csize - 1)) == 0) {	/* Cluster changed? */
+			if (((ofs >> SS_SH(fs)) & (fs->csize - 1)) == 0) {	/* Cluster changed? */
 				clst = get_fat(&dp->obj, dp->clust);		/* Get next cluster */
 				if (clst <= 1) return FR_INT_ERR;			/* Internal error */
 				if (clst == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error */
@@ -1790,7 +2033,7 @@ static FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DEN
 		}
 	}
 	dp->dptr = ofs;						/* Current entry */
-	dp->dir = fs->win + ofs % SS(fs);	/* Pointer to the entry in the win[] */
+	dp->dir = fs->win + SS_OFS(fs, ofs);	/* Pointer to the entry in the win[] */
 
 	return FR_OK;
 }
@@ -2745,6 +2988,11 @@ static void get_fileinfo (
 	fno->fsize = ld_dword(dp->dir + DIR_FileSize);		/* Size */
 	fno->ftime = ld_word(dp->dir + DIR_ModTime + 0);	/* Time */
 	fno->fdate = ld_word(dp->dir + DIR_ModTime + 2);	/* Date */
+	// WBW (start)
+#if FF_DIR_WALK
+	fno->fclust = ld_clust(dp->obj.fs, dp->dir);		/* Start cluster */
+#endif
+	// WBW (end)
 }
 
 #endif /* FF_FS_MINIMIZE <= 1 || FF_FS_RPATH >= 2 */
@@ -3210,6 +3458,91 @@ static int get_ldnumber (	/* Returns logical drive number (-1:invalid drive numb
 
 
 
+// WBW (start)
+/*-----------------------------------------------------------------------*/
+/* Table driven CRC32 (IEEE 802.3, reflected)                            */
+/*-----------------------------------------------------------------------*/
+
+#if FF_USE_CRC32
+
+#if FF_Z80_ASM
+/* The table is held as 4 byte planes, one 256 byte page each, so the
+/  assembler loop can index it with a single register */
+static BYTE CrcBuf[4 * 256 + 255];	/* Table planes, aligned at run time */
+static BYTE* CrcTab;				/* First plane (0:Not built yet) */
+
+DWORD ff_crc32 (	/* Returns updated CRC register */
+	DWORD crc,		/* Current CRC register (start with 0xFFFFFFFF) */
+	const void* buf,	/* Data to be processed */
+	UINT len		/* Number of bytes */
+)
+{
+	UINT i;
+	BYTE b;
+	DWORD c;
+
+
+	if (!CrcTab) {	/* Build the table on first use */
+		CrcTab = CrcBuf + ((256 - ((UINT)CrcBuf & 255)) & 255);
+		for (i = 0; i < 256; i++) {
+			c = i;
+			for (b = 0; b < 8; b++) c = (c & 1) ? c >> 1 ^ 0xEDB88320 : c >> 1;
+			CrcTab[i] = (BYTE)c;
+			CrcTab[i + 256] = (BYTE)(c >> 8);
+			CrcTab[i + 512] = (BYTE)(c >> 16);
+			CrcTab[i + 768] = (BYTE)(c >> 24);
+		}
+	}
+	return ff_crc32_z80(crc, (const BYTE*)buf, len, CrcTab);
+}
+
+#else
+/* Slicing-by-8: CrcTab[k][i] is the CRC of byte i followed by k zero bytes */
+static DWORD CrcTab[8][256];
+static BYTE CrcInit;				/* Table built */
+
+DWORD ff_crc32 (	/* Returns updated CRC register */
+	DWORD crc,		/* Current CRC register (start with 0xFFFFFFFF) */
+	const void* buf,	/* Data to be processed */
+	UINT len		/* Number of bytes */
+)
+{
+	const BYTE* p = (const BYTE*)buf;
+	UINT i, k;
+	DWORD c;
+
+
+	if (!CrcInit) {	/* Build the tables on first use */
+		for (i = 0; i < 256; i++) {
+			c = i;
+			for (k = 0; k < 8; k++) c = (c & 1) ? c >> 1 ^ 0xEDB88320 : c >> 1;
+			CrcTab[0][i] = c;
+		}
+		for (i = 0; i < 256; i++) {
+			for (k = 1; k < 8; k++) CrcTab[k][i] = CrcTab[k - 1][i] >> 8 ^ CrcTab[0][CrcTab[k - 1][i] & 0xFF];
+		}
+		CrcInit = 1;
+	}
+	crc &= 0xFFFFFFFF;
+	for ( ; len >= 8; len -= 8, p += 8) {	/* 8 bytes at a time */
+		crc ^= (DWORD)p[0] | (DWORD)p[1] << 8 | (DWORD)p[2] << 16 | (DWORD)p[3] << 24;
+		crc = CrcTab[7][crc & 0xFF] ^ CrcTab[6][crc >> 8 & 0xFF]
+			^ CrcTab[5][crc >> 16 & 0xFF] ^ CrcTab[4][crc >> 24 & 0xFF]
+			^ CrcTab[3][p[4]] ^ CrcTab[2][p[5]] ^ CrcTab[1][p[6]] ^ CrcTab[0][p[7]];
+	}
+	for ( ; len; len--) {	/* Remaining bytes */
+		crc = crc >> 8 ^ CrcTab[0][(crc ^ *p++) & 0xFF];
+	}
+	return crc;
+}
+#endif
+
+#endif	/* FF_USE_CRC32 */
+// WBW (end)
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* GPT support functions                                                 */
 /*-----------------------------------------------------------------------*/
@@ -3223,6 +3556,11 @@ static DWORD crc32 (	/* Returns next CRC value */
 	BYTE d				/* A byte to be processed */
 )
 {
+// WBW (start)
+#if FF_USE_CRC32
+	return ff_crc32(crc, &d, 1);
+#else
+// WBW (end)
 	BYTE b;
 
 
@@ -3231,6 +3569,9 @@ static DWORD crc32 (	/* Returns next CRC value */
 		crc = (crc & 1) ? crc >> 1 ^ 0xEDB88320 : crc >> 1;
 	}
 	return crc;
+// WBW (start)
+#endif
+// WBW (end)
 }
 
 
@@ -3435,6 +3776,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 #if FF_MAX_SS != FF_MIN_SS				/* Get sector size (multiple sector size cfg only) */
 	if (disk_ioctl(fs->pdrv, GET_SECTOR_SIZE, &SS(fs)) != RES_OK) return FR_DISK_ERR;
 	if (SS(fs) > FF_MAX_SS || SS(fs) < FF_MIN_SS || (SS(fs) & (SS(fs) - 1))) return FR_DISK_ERR;
+	// WBW (start)
+	for (fs->ssize_sh = 0; (1U << fs->ssize_sh) < SS(fs); fs->ssize_sh++) ;	/* Sector size shift */
+	// WBW (end)
 #endif
 
 	/* Find an FAT volume on the hosting drive */
@@ -3469,6 +3813,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 
 		fs->csize = 1 << fs->win[BPB_SecPerClusEx];		/* Cluster size */
 		if (fs->csize == 0)	return FR_NO_FILESYSTEM;	/* (Must be 1..32768 sectors) */
+		// WBW (start)
+		fs->csize_sh = fs->win[BPB_SecPerClusEx];		/* Cluster size shift */
+		// WBW (end)
 
 		nclst = ld_dword(fs->win + BPB_NumClusEx);		/* Number of clusters */
 		if (nclst > MAX_EXFAT) return FR_NO_FILESYSTEM;	/* (Too many clusters) */
@@ -3521,6 +3868,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 
 		fs->csize = fs->win[BPB_SecPerClus];			/* Cluster size */
 		if (fs->csize == 0 || (fs->csize & (fs->csize - 1))) return FR_NO_FILESYSTEM;	/* (Must be power of 2) */
+		// WBW (start)
+		for (fs->csize_sh = 0; (1U << fs->csize_sh) < fs->csize; fs->csize_sh++) ;	/* Cluster size shift */
+		// WBW (end)
 
 		fs->n_rootdir = ld_word(fs->win + BPB_RootEntCnt);	/* Number of root directory entries */
 		if (fs->n_rootdir % (SS(fs) / SZDIRE)) return FR_NO_FILESYSTEM;	/* (Must be sector aligned) */
@@ -3541,6 +3891,20 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 		if (nclst <= MAX_FAT16) fmt = FS_FAT16;
 		if (nclst <= MAX_FAT12) fmt = FS_FAT12;
 		if (fmt == 0) return FR_NO_FILESYSTEM;
+		// WBW (start)
+		if (!(FF_FS_FATTYPES & (1 << (fmt - 1)))) return FR_NO_FILESYSTEM;	/* (FAT sub-type not supported by the configuration) */
+#if FF_FAT_MULTI
+#if FF_FS_FATTYPES & 1
+		if (fmt == FS_FAT12) fs->facc = &FatAcc12;	/* Bind FAT entry accessors */
+#endif
+#if FF_FS_FATTYPES & 2
+		if (fmt == FS_FAT16) fs->facc = &FatAcc16;
+#endif
+#if FF_FS_FATTYPES & 4
+		if (fmt == FS_FAT32) fs->facc = &FatAcc32;
+#endif
+#endif
+		// WBW (end)
 
 		/* Boundaries and Limits */
 		fs->n_fatent = nclst + 2;						/* Number of FAT entries */
@@ -3586,6 +3950,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 #endif	/* !FF_FS_READONLY */
 	}
 
+#if FF_FS_FILPOOL
+	memset(fs->pown, 0, sizeof fs->pown);	/* All sector buffers of the pool are free */
+#endif
 	fs->fs_type = (BYTE)fmt;/* FAT sub-type (the filesystem object gets valid) */
 	fs->id = ++Fsid;		/* Volume mount ID */
 #if FF_USE_LFN == 1
@@ -3641,6 +4008,60 @@ static FRESULT validate (	/* Returns FR_OK or FR_INVALID_OBJECT */
 
 
 
+// WBW (start)
+/*-----------------------------------------------------------------------*/
+/* Directory relative lookup for the f_xxxat() functions                 */
+/*-----------------------------------------------------------------------*/
+/* With an open directory object given, the volume is checked through the
+/  directory object and the name is a single segment looked up in that
+/  directory only. Without it, they fall back to the full path functions. */
+
+static FRESULT mount_at (	/* FR_OK(0): successful, !=0: an error occurred */
+	const TCHAR** path,		/* Pointer to pointer to the path name (drive number) */
+	FATFS** rfs,			/* Pointer to pointer to the found filesystem object */
+	BYTE mode,				/* Desiered access mode to check write protection */
+	const DIR* at			/* Directory to look up the name in (null: full path) */
+)
+{
+	FRESULT res;
+
+
+	if (!at) return mount_volume(path, rfs, mode);
+
+	res = validate((FFOBJID*)&at->obj, rfs);	/* Volume of the directory is kept mounted */
+	if (!FF_FS_READONLY && res == FR_OK && (mode & (BYTE)~FA_READ)) {
+		if (disk_status((*rfs)->pdrv) & STA_PROTECT) res = FR_WRITE_PROTECTED;	/* Check write protection if needed */
+	}
+	return res;
+}
+
+
+static FRESULT follow_at (	/* FR_OK(0): successful, !=0: error code */
+	DIR* dp,				/* Directory object to return last directory and found object */
+	const TCHAR* path,		/* Full path, or a bare name with at */
+	const DIR* at			/* Directory to look up the name in (null: full path) */
+)
+{
+	FRESULT res;
+
+
+	if (!at) return follow_path(dp, path);
+
+	dp->obj = at->obj;					/* Start at the given directory */
+	res = create_name(dp, &path);		/* Get the name */
+	if (res == FR_OK) {
+		if ((dp->fn[NSFLAG] & (NS_LAST | NS_DOT)) != NS_LAST) {	/* Reject a path or dot entry */
+			res = FR_INVALID_NAME;
+		} else {
+			res = dir_find(dp);			/* Find the object in the directory */
+		}
+	}
+	return res;
+}
+// WBW (end)
+
+
+
 
 /*---------------------------------------------------------------------------
 
@@ -3714,11 +4135,24 @@ FRESULT f_mount (
 /* Open or Create a File                                                 */
 /*-----------------------------------------------------------------------*/
 
+// WBW (start)
 FRESULT f_open (
 	FIL* fp,			/* Pointer to the blank file object */
 	const TCHAR* path,	/* Pointer to the file name */
 	BYTE mode			/* Access mode and open mode flags */
 )
+{
+	return f_openat(fp, 0, path, mode);
+}
+
+
+FRESULT f_openat (
+	FIL* fp,			/* Pointer to the blank file object */
+	const DIR* at,		/* Directory to open the file in (null: path is a full path) */
+	const TCHAR* path,	/* Pointer to the file name */
+	BYTE mode			/* Access mode and open mode flags */
+)
+// WBW (end)
 {
 	FRESULT res;
 	DIR dj;
@@ -3728,6 +4162,7 @@ FRESULT f_open (
 	LBA_t sc;
 	FSIZE_t ofs;
 #endif
+	BYTE crt = 0;
 	DEF_NAMBUF
 
 
@@ -3735,11 +4170,17 @@ FRESULT f_open (
 
 	/* Get logical drive number */
 	mode &= FF_FS_READONLY ? FA_READ : FA_READ | FA_WRITE | FA_CREATE_ALWAYS | FA_CREATE_NEW | FA_OPEN_ALWAYS | FA_OPEN_APPEND;
-	res = mount_volume(&path, &fs, mode);
+	// WBW (start)
+	//res = mount_volume(&path, &fs, mode);
+	res = mount_at(&path, &fs, mode, at);
+	// WBW (end)
 	if (res == FR_OK) {
 		dj.obj.fs = fs;
 		INIT_NAMBUF(fs);
-		res = follow_path(&dj, path);	/* Follow the file path */
+		// WBW (start)
+		//res = follow_path(&dj, path);	/* Follow the file path */
+		res = follow_at(&dj, path, at);	/* Follow the file path */
+		// WBW (end)
 #if !FF_FS_READONLY	/* Read/Write configuration */
 		if (res == FR_OK) {
 			if (dj.fn[NSFLAG] & NS_NONAME) {	/* Origin directory itself? */
@@ -3762,6 +4203,7 @@ FRESULT f_open (
 #endif
 				}
 				mode |= FA_CREATE_ALWAYS;		/* File is created */
+				crt = 1;
 			}
 			else {								/* Any object with the same name is already existing */
 				if (dj.obj.attr & (AM_RDO | AM_DIR)) {	/* Cannot overwrite it (R/O or DIR) */
@@ -3862,10 +4304,14 @@ FRESULT f_open (
 			fp->obj.id = fs->id;
 			fp->flag = mode;	/* Set file access mode */
 			fp->err = 0;		/* Clear error flag */
+			fp->created = crt;	/* Tell whether the file was created */
 			fp->sect = 0;		/* Invalidate current data sector */
 			fp->fptr = 0;		/* Set file pointer top of the file */
+#if FF_FS_FILPOOL
+			fp->buf = 0;		/* Sector buffer is taken from the pool when needed */
+#endif
 #if !FF_FS_READONLY
-#if !FF_FS_TINY
+#if !FF_FS_TINY && !FF_FS_FILPOOL
 			memset(fp->buf, 0, sizeof fp->buf);	/* Clear sector buffer */
 #endif
 			if ((mode & FA_SEEKEND) && fp->obj.objsize > 0) {	/* Seek to end of file if FA_OPEN_APPEND is specified */
@@ -3885,7 +4331,7 @@ FRESULT f_open (
 					} else {
 						fp->sect = sc + (DWORD)(ofs / SS(fs));
 #if !FF_FS_TINY
-						if (disk_read(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) res = FR_DISK_ERR;
+						if (GET_FBUF(fp, 0) != FR_OK || disk_read(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) res = FR_DISK_ERR;
 #endif
 					}
 				}
@@ -3935,8 +4381,8 @@ FRESULT f_read (
 	if (btr > remain) btr = (UINT)remain;		/* Truncate btr by remaining bytes */
 
 	for ( ; btr > 0; btr -= rcnt, *br += rcnt, rbuff += rcnt, fp->fptr += rcnt) {	/* Repeat until btr bytes read */
-		if (fp->fptr % SS(fs) == 0) {			/* On the sector boundary? */
-			csect = (UINT)(fp->fptr / SS(fs) & (fs->csize - 1));	/* Sector offset in the cluster */
+		if (SS_OFS(fs, fp->fptr) == 0) {			/* On the sector boundary? */
+			csect = (UINT)(fp->fptr >> SS_SH(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
 			if (csect == 0) {					/* On the cluster boundary? */
 				if (fp->fptr == 0) {			/* On the top of the file? */
 					clst = fp->obj.sclust;		/* Follow cluster chain from the origin */
@@ -3957,7 +4403,7 @@ FRESULT f_read (
 			sect = clst2sect(fs, fp->clust);	/* Get current sector */
 			if (sect == 0) ABORT(fs, FR_INT_ERR);
 			sect += csect;
-			cc = btr / SS(fs);					/* When remaining bytes >= sector size, */
+			cc = btr >> SS_SH(fs);					/* When remaining bytes >= sector size, */
 			if (cc > 0) {						/* Read maximum contiguous sectors directly */
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
 					cc = fs->csize - csect;
@@ -3966,18 +4412,19 @@ FRESULT f_read (
 #if !FF_FS_READONLY && FF_FS_MINIMIZE <= 2		/* Replace one of the read sectors with cached data if it contains a dirty sector */
 #if FF_FS_TINY
 				if (fs->wflag && fs->winsect - sect < cc) {
-					memcpy(rbuff + ((fs->winsect - sect) * SS(fs)), fs->win, SS(fs));
+					ff_memcpy(rbuff + ((UINT)(fs->winsect - sect) << SS_SH(fs)), fs->win, SS(fs));
 				}
 #else
 				if ((fp->flag & FA_DIRTY) && fp->sect - sect < cc) {
-					memcpy(rbuff + ((fp->sect - sect) * SS(fs)), fp->buf, SS(fs));
+					ff_memcpy(rbuff + ((UINT)(fp->sect - sect) << SS_SH(fs)), fp->buf, SS(fs));
 				}
 #endif
 #endif
-				rcnt = SS(fs) * cc;				/* Number of bytes transferred */
+				rcnt = cc << SS_SH(fs);				/* Number of bytes transferred */
 				continue;
 			}
 #if !FF_FS_TINY
+			if (GET_FBUF(fp, fp->sect == sect) != FR_OK) ABORT(fs, FR_DISK_ERR);
 			if (fp->sect != sect) {			/* Load data sector if not in cache */
 #if !FF_FS_READONLY
 				if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
@@ -3990,13 +4437,14 @@ FRESULT f_read (
 #endif
 			fp->sect = sect;
 		}
-		rcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
+		rcnt = SS(fs) - SS_OFS(fs, fp->fptr);	/* Number of bytes remains in the sector */
 		if (rcnt > btr) rcnt = btr;					/* Clip it by btr if needed */
 #if FF_FS_TINY
 		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		memcpy(rbuff, fs->win + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+		ff_memcpy(rbuff, fs->win + SS_OFS(fs, fp->fptr), rcnt);	/* Extract partial sector */
 #else
-		memcpy(rbuff, fp->buf + fp->fptr % SS(fs), rcnt);	/* Extract partial sector */
+		if (GET_FBUF(fp, 1) != FR_OK) ABORT(fs, FR_DISK_ERR);
+		ff_memcpy(rbuff, fp->buf + SS_OFS(fs, fp->fptr), rcnt);	/* Extract partial sector */
 #endif
 	}
 
@@ -4037,8 +4485,8 @@ FRESULT f_write (
 	}
 
 	for ( ; btw > 0; btw -= wcnt, *bw += wcnt, wbuff += wcnt, fp->fptr += wcnt, fp->obj.objsize = (fp->fptr > fp->obj.objsize) ? fp->fptr : fp->obj.objsize) {	/* Repeat until all data written */
-		if (fp->fptr % SS(fs) == 0) {		/* On the sector boundary? */
-			csect = (UINT)(fp->fptr / SS(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
+		if (SS_OFS(fs, fp->fptr) == 0) {		/* On the sector boundary? */
+			csect = (UINT)(fp->fptr >> SS_SH(fs)) & (fs->csize - 1);	/* Sector offset in the cluster */
 			if (csect == 0) {				/* On the cluster boundary? */
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->obj.sclust;	/* Follow from the origin */
@@ -4072,7 +4520,7 @@ FRESULT f_write (
 			sect = clst2sect(fs, fp->clust);	/* Get current sector */
 			if (sect == 0) ABORT(fs, FR_INT_ERR);
 			sect += csect;
-			cc = btw / SS(fs);				/* When remaining bytes >= sector size, */
+			cc = btw >> SS_SH(fs);				/* When remaining bytes >= sector size, */
 			if (cc > 0) {					/* Write maximum contiguous sectors directly */
 				if (csect + cc > fs->csize) {	/* Clip at cluster boundary */
 					cc = fs->csize - csect;
@@ -4081,17 +4529,22 @@ FRESULT f_write (
 #if FF_FS_MINIMIZE <= 2
 #if FF_FS_TINY
 				if (fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
-					memcpy(fs->win, wbuff + ((fs->winsect - sect) * SS(fs)), SS(fs));
+					ff_memcpy(fs->win, wbuff + ((UINT)(fs->winsect - sect) << SS_SH(fs)), SS(fs));
 					fs->wflag = 0;
 				}
+#elif FF_FS_FILPOOL
+				if (fp->buf && fp->sect - sect < cc) { /* Refill sector cache (if still held) if it gets invalidated by the direct write */
+					ff_memcpy(fp->buf, wbuff + ((UINT)(fp->sect - sect) << SS_SH(fs)), SS(fs));
+					fp->flag &= (BYTE)~FA_DIRTY;
+				}
 #else
 				if (fp->sect - sect < cc) { /* Refill sector cache if it gets invalidated by the direct write */
-					memcpy(fp->buf, wbuff + ((fp->sect - sect) * SS(fs)), SS(fs));
+					ff_memcpy(fp->buf, wbuff + ((UINT)(fp->sect - sect) << SS_SH(fs)), SS(fs));
 					fp->flag &= (BYTE)~FA_DIRTY;
 				}
 #endif
 #endif
-				wcnt = SS(fs) * cc;		/* Number of bytes transferred */
+				wcnt = cc << SS_SH(fs);		/* Number of bytes transferred */
 				continue;
 			}
 #if FF_FS_TINY
@@ -4100,6 +4553,7 @@ FRESULT f_write (
 				fs->winsect = sect;
 			}
 #else
+			if (GET_FBUF(fp, fp->sect == sect) != FR_OK) ABORT(fs, FR_DISK_ERR);
 			if (fp->sect != sect && 		/* Fill sector cache with file data */
 				fp->fptr < fp->obj.objsize &&
 				disk_read(fs->pdrv, fp->buf, sect, 1) != RES_OK) {
@@ -4108,14 +4562,15 @@ FRESULT f_write (
 #endif
 			fp->sect = sect;
 		}
-		wcnt = SS(fs) - (UINT)fp->fptr % SS(fs);	/* Number of bytes remains in the sector */
+		wcnt = SS(fs) - SS_OFS(fs, fp->fptr);	/* Number of bytes remains in the sector */
 		if (wcnt > btw) wcnt = btw;					/* Clip it by btw if needed */
 #if FF_FS_TINY
 		if (move_window(fs, fp->sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window */
-		memcpy(fs->win + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
+		ff_memcpy(fs->win + SS_OFS(fs, fp->fptr), wbuff, wcnt);	/* Fit data to the sector */
 		fs->wflag = 1;
 #else
-		memcpy(fp->buf + fp->fptr % SS(fs), wbuff, wcnt);	/* Fit data to the sector */
+		if (GET_FBUF(fp, 1) != FR_OK) ABORT(fs, FR_DISK_ERR);
+		ff_memcpy(fp->buf + SS_OFS(fs, fp->fptr), wbuff, wcnt);	/* Fit data to the sector */
 		fp->flag |= FA_DIRTY;
 #endif
 	}
@@ -4204,6 +4659,38 @@ FRESULT f_sync (
 	LEAVE_FF(fs, res);
 }
 
+
+
+// WBW (start)
+/*-----------------------------------------------------------------------*/
+/* Change Timestamp of an Open File                                      */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_futime (
+	FIL* fp,				/* Open file to be changed */
+	const FILINFO* fno		/* Pointer to the timestamp to be set */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = f_sync(fp);		/* Flush first, that sets the current time */
+	if (res != FR_OK) return res;
+
+	fs = fp->obj.fs;
+	if (fs->fs_type == FS_EXFAT) return FR_INVALID_PARAMETER;	/* Only FAT entries are handled */
+	res = move_window(fs, fp->dir_sect);
+	if (res == FR_OK) {
+		st_dword(fp->dir_ptr + DIR_ModTime, (DWORD)fno->fdate << 16 | fno->ftime);
+		fs->wflag = 1;
+		res = sync_fs(fs);
+	}
+
+	return res;
+}
+// WBW (end)
+
 #endif /* !FF_FS_READONLY */
 
 
@@ -4222,11 +4709,23 @@ FRESULT f_close (
 
 #if !FF_FS_READONLY
 	res = f_sync(fp);					/* Flush cached data */
+#if FF_FS_FILPOOL
+	if (res != FR_OK && validate(&fp->obj, &fs) == FR_OK) {	/* Do not leave the pool buffer owned by a file that failed to close */
+		put_fbuf(fp);					/* Return sector buffer to the pool */
+		fp->flag &= (BYTE)~FA_DIRTY;	/* Its unwritten sector goes with the buffer */
+#if FF_FS_REENTRANT
+		unlock_volume(fs, FR_OK);		/* Unlock volume */
+#endif
+	}
+#endif
 	if (res == FR_OK)
 #endif
 	{
 		res = validate(&fp->obj, &fs);	/* Lock volume */
 		if (res == FR_OK) {
+#if FF_FS_FILPOOL
+			put_fbuf(fp);					/* Return sector buffer to the pool */
+#endif
 #if FF_FS_LOCK
 			res = dec_share(fp->obj.lockid);		/* Decrement file open counter */
 			if (res == FR_OK) fp->obj.fs = 0;	/* Invalidate file object */
@@ -4492,6 +4991,7 @@ FRESULT f_lseek (
 				dsc += (DWORD)((ofs - 1) / SS(fs)) & (fs->csize - 1);
 				if (fp->fptr % SS(fs) && dsc != fp->sect) {	/* Refill sector cache if needed */
 #if !FF_FS_TINY
+					if (GET_FBUF(fp, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY
 					if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
 						if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
@@ -4518,9 +5018,9 @@ FRESULT f_lseek (
 		ifptr = fp->fptr;
 		fp->fptr = nsect = 0;
 		if (ofs > 0) {
-			bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size (byte) */
+			bcs = (DWORD)fs->csize << SS_SH(fs);	/* Cluster size (byte) */
 			if (ifptr > 0 &&
-				(ofs - 1) / bcs >= (ifptr - 1) / bcs) {	/* When seek to same or following cluster, */
+				(ofs - 1) >> CL_SH(fs) >= (ifptr - 1) >> CL_SH(fs)) {	/* When seek to same or following cluster, */
 				fp->fptr = (ifptr - 1) & ~(FSIZE_t)(bcs - 1);	/* start from the current cluster */
 				ofs -= fp->fptr;
 				clst = fp->clust;
@@ -4559,10 +5059,10 @@ FRESULT f_lseek (
 					fp->clust = clst;
 				}
 				fp->fptr += ofs;
-				if (ofs % SS(fs)) {
+				if (SS_OFS(fs, ofs)) {
 					nsect = clst2sect(fs, clst);	/* Current sector */
 					if (nsect == 0) ABORT(fs, FR_INT_ERR);
-					nsect += (DWORD)(ofs / SS(fs));
+					nsect += (DWORD)(ofs >> SS_SH(fs));
 				}
 			}
 		}
@@ -4570,8 +5070,9 @@ FRESULT f_lseek (
 			fp->obj.objsize = fp->fptr;
 			fp->flag |= FA_MODIFIED;
 		}
-		if (fp->fptr % SS(fs) && nsect != fp->sect) {	/* Fill sector cache if needed */
+		if (SS_OFS(fs, fp->fptr) && nsect != fp->sect) {	/* Fill sector cache if needed */
 #if !FF_FS_TINY
+			if (GET_FBUF(fp, 0) != FR_OK) ABORT(fs, FR_DISK_ERR);
 #if !FF_FS_READONLY
 			if (fp->flag & FA_DIRTY) {			/* Write-back dirty sector cache */
 				if (disk_write(fs->pdrv, fp->buf, fp->sect, 1) != RES_OK) ABORT(fs, FR_DISK_ERR);
@@ -4721,6 +5222,39 @@ FRESULT f_readdir (
 
 
 
+// WBW (start)
+#if FF_DIR_WALK
+/*-----------------------------------------------------------------------*/
+/* Move Directory Object to Another Directory                            */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_dirat (
+	DIR* dp,			/* Pointer to the open directory object */
+	DWORD sclust,		/* Start cluster of the directory (0:root, as in FILINFO.fclust) */
+	DWORD ofs			/* Offset of the next entry to read */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+
+
+	res = validate(&dp->obj, &fs);	/* Check validity of the directory object */
+	if (res == FR_OK) {
+		if (sclust != 0 && (sclust < 2 || sclust >= fs->n_fatent)) {
+			res = FR_INT_ERR;
+		} else {
+			dp->obj.sclust = sclust;	/* Same volume, other table */
+			res = dir_sdi(dp, ofs);		/* Set read index */
+		}
+	}
+	LEAVE_FF(fs, res);
+}
+
+#endif
+// WBW (end)
+
+
+
 #if FF_USE_FIND
 /*-----------------------------------------------------------------------*/
 /* Find Next File                                                        */
@@ -4778,10 +5312,22 @@ FRESULT f_findfirst (
 /* Get File Status                                                       */
 /*-----------------------------------------------------------------------*/
 
+// WBW (start)
 FRESULT f_stat (
 	const TCHAR* path,	/* Pointer to the file path */
 	FILINFO* fno		/* Pointer to file information to return */
 )
+{
+	return f_statat(0, path, fno);
+}
+
+
+FRESULT f_statat (
+	const DIR* at,		/* Directory to find the file in (null: path is a full path) */
+	const TCHAR* path,	/* Pointer to the file path */
+	FILINFO* fno		/* Pointer to file information to return */
+)
+// WBW (end)
 {
 	FRESULT res;
 	DIR dj;
@@ -4789,10 +5335,16 @@ FRESULT f_stat (
 
 
 	/* Get logical drive */
-	res = mount_volume(&path, &dj.obj.fs, 0);
+	// WBW (start)
+	//res = mount_volume(&path, &dj.obj.fs, 0);
+	res = mount_at(&path, &dj.obj.fs, 0, at);
+	// WBW (end)
 	if (res == FR_OK) {
 		INIT_NAMBUF(dj.obj.fs);
-		res = follow_path(&dj, path);	/* Follow the file path */
+		// WBW (start)
+		//res = follow_path(&dj, path);	/* Follow the file path */
+		res = follow_at(&dj, path, at);	/* Follow the file path */
+		// WBW (end)
 		if (res == FR_OK) {				/* Follow completed */
 			if (dj.fn[NSFLAG] & NS_NONAME) {	/* It is origin directory */
 				res = FR_INVALID_NAME;
@@ -4837,7 +5389,7 @@ FRESULT f_getfree (
 		} else {
 			/* Scan FAT to obtain number of free clusters */
 			nfree = 0;
-			if (fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
+			if (FF_FS_FATTYPES & 1 && fs->fs_type == FS_FAT12) {	/* FAT12: Scan bit field FAT entries */
 				clst = 2; obj.fs = fs;
 				do {
 					stat = get_fat(&obj, clst);
@@ -4875,20 +5427,27 @@ FRESULT f_getfree (
 					clst = fs->n_fatent;	/* Number of entries */
 					sect = fs->fatbase;		/* Top of the FAT */
 					i = 0;					/* Offset in the sector */
-					do {	/* Counts numbuer of entries with zero in the FAT */
-						if (i == 0) {	/* New sector? */
-							res = move_window(fs, sect++);
-							if (res != FR_OK) break;
-						}
-						if (fs->fs_type == FS_FAT16) {
+					// WBW (start)
+					if (FF_FS_FATTYPES & 2 && fs->fs_type == FS_FAT16) {
+						do {	/* Counts numbuer of WORD entries with zero in the FAT */
+							if (i == 0) {	/* New sector? */
+								res = move_window(fs, sect++);
+								if (res != FR_OK) break;
+							}
 							if (ld_word(fs->win + i) == 0) nfree++;
-							i += 2;
-						} else {
+							i = SS_OFS(fs, i + 2);
+						} while (--clst);
+					} else {
+						do {	/* Counts numbuer of DWORD entries with zero in the FAT */
+							if (i == 0) {	/* New sector? */
+								res = move_window(fs, sect++);
+								if (res != FR_OK) break;
+							}
 							if ((ld_dword(fs->win + i) & 0x0FFFFFFF) == 0) nfree++;
-							i += 4;
-						}
-						i %= SS(fs);
-					} while (--clst);
+							i = SS_OFS(fs, i + 4);
+						} while (--clst);
+					}
+					// WBW (end)
 				}
 			}
 			if (res == FR_OK) {		/* Update parameters if succeeded */
@@ -4959,9 +5518,20 @@ FRESULT f_truncate (
 /* Delete a File/Directory                                               */
 /*-----------------------------------------------------------------------*/
 
+// WBW (start)
 FRESULT f_unlink (
 	const TCHAR* path		/* Pointer to the file or directory path */
 )
+{
+	return f_unlinkat(0, path);
+}
+
+
+FRESULT f_unlinkat (
+	const DIR* at,			/* Directory to remove the object from (null: path is a full path) */
+	const TCHAR* path		/* Pointer to the file or directory path */
+)
+// WBW (end)
 {
 	FRESULT res;
 	FATFS *fs;
@@ -4974,11 +5544,17 @@ FRESULT f_unlink (
 
 
 	/* Get logical drive */
-	res = mount_volume(&path, &fs, FA_WRITE);
+	// WBW (start)
+	//res = mount_volume(&path, &fs, FA_WRITE);
+	res = mount_at(&path, &fs, FA_WRITE, at);
+	// WBW (end)
 	if (res == FR_OK) {
 		dj.obj.fs = fs;
 		INIT_NAMBUF(fs);
-		res = follow_path(&dj, path);		/* Follow the file path */
+		// WBW (start)
+		//res = follow_path(&dj, path);		/* Follow the file path */
+		res = follow_at(&dj, path, at);		/* Follow the file path */
+		// WBW (end)
 		if (FF_FS_RPATH && res == FR_OK && (dj.fn[NSFLAG] & NS_DOT)) {
 			res = FR_INVALID_NAME;			/* Cannot remove dot entry */
 		}
@@ -5048,6 +5624,315 @@ FRESULT f_unlink (
 
 
 
+// WBW (start)
+#if FF_USE_FIND && !FF_FS_EXFAT
+/*-----------------------------------------------------------------------*/
+/* Delete Matching Files in a Single Directory Pass                      */
+/*-----------------------------------------------------------------------*/
+/* The matching entries are marked deleted while their directory sector is
+/  held in the window. Their cluster chains are collected in cluster order
+/  and released DEL_BATCH at a time, so the window does not swing between
+/  the directory and the FAT for every file. The FAT and FSInfo are synced
+/  once at the end. Matching sub-directories are removed too if they are
+/  empty, as f_unlink() does, otherwise it is terminated with FR_DENIED. */
+
+#define DEL_BATCH	32		/* Number of cluster chains collected before releasing */
+
+static FRESULT release_chains (	/* FR_OK(0):succeeded, !=0:error */
+	FFOBJID* obj,			/* Corresponding object */
+	const DWORD* tbl,		/* Sorted table of top clusters of the chains */
+	UINT n					/* Number of chains */
+)
+{
+	FRESULT res = FR_OK;
+	UINT i;
+
+
+	for (i = 0; i < n && res == FR_OK; i++) {
+		res = remove_chain(obj, tbl[i], 0);
+	}
+	return res;
+}
+
+
+FRESULT f_unlinkfind (
+	DIR* dp,				/* Pointer to the open directory object */
+	const TCHAR* pattern,	/* Pointer to the matching pattern */
+	UINT* ndel,				/* Pointer to number of files deleted */
+	void (*func)(const FILINFO*)	/* Pointer to the function called for each deleted file (null: none) */
+)
+{
+	FRESULT res, res2;
+	FATFS *fs;
+	DIR sdj;
+	FILINFO fno;
+	DWORD tbl[DEL_BATCH], clst;
+	UINT n, i, cnt;
+
+
+	cnt = n = 0;
+	res = mount_at(0, &fs, FA_WRITE, dp);	/* Check validity of the directory object */
+	if (res == FR_OK) res = dir_sdi(dp, 0);	/* Rewind directory */
+	while (res == FR_OK) {
+		res = DIR_READ_FILE(dp);			/* Get a directory item */
+		if (res != FR_OK) break;			/* Terminate at end of directory */
+		get_fileinfo(dp, &fno);
+		if ((pattern_match(pattern, fno.fname, 0, FIND_RECURS)
+#if FF_USE_LFN && FF_USE_FIND == 2
+			|| pattern_match(pattern, fno.altname, 0, FIND_RECURS)
+#endif
+			)) {
+			if (fno.fattrib & AM_RDO) {		/* Cannot remove R/O object */
+				res = FR_DENIED; break;
+			}
+#if FF_FS_LOCK
+			res = chk_share(dp, 2);			/* Check if it is an open object */
+			if (res != FR_OK) break;
+#endif
+			clst = ld_clust(fs, dp->dir);
+			if (fno.fattrib & AM_DIR) {		/* Is it a sub-directory? */
+				sdj.obj.fs = fs;			/* Open the sub-directory */
+				sdj.obj.sclust = clst;
+				res = dir_sdi(&sdj, 0);
+				if (res == FR_OK) {
+					res = DIR_READ_FILE(&sdj);			/* Test if the directory is empty */
+					if (res == FR_OK) res = FR_DENIED;	/* Not empty? */
+					if (res == FR_NO_FILE) res = FR_OK;	/* Empty? */
+				}
+				if (res != FR_OK) break;
+			}
+			res = dir_remove(dp);			/* Mark the entry deleted in the window */
+			if (res != FR_OK) break;
+			cnt++;
+			if (func) func(&fno);
+			if (clst != 0) {				/* Add the chain to the sorted table */
+				if (n == DEL_BATCH) {
+					res = release_chains(&dp->obj, tbl, n);
+					n = 0;
+					if (res != FR_OK) break;
+				}
+				for (i = n++; i > 0 && tbl[i - 1] > clst; i--) tbl[i] = tbl[i - 1];
+				tbl[i] = clst;
+			}
+		}
+		res = dir_next(dp, 0);				/* Next entry */
+	}
+	if (res == FR_NO_FILE) res = FR_OK;		/* End of directory */
+	if (fs && cnt) {						/* Release the remaining chains of removed entries even on error */
+		res2 = release_chains(&dp->obj, tbl, n);
+		if (res2 == FR_OK) res2 = sync_fs(fs);
+		if (res == FR_OK) res = res2;
+	}
+	if (ndel) *ndel = cnt;
+
+	LEAVE_FF(fs, res);
+}
+#endif
+// WBW (end)
+
+
+
+// WBW (start)
+#if FF_USE_FIND && !FF_USE_LFN && !FF_FS_EXFAT
+/*-----------------------------------------------------------------------*/
+/* Rename Matching Files by a Wildcard Pattern in a Single Pass          */
+/*-----------------------------------------------------------------------*/
+/* The directory is read once to map each matching name onto the new name
+/  and to collect the names that will exist afterwards in the work area.
+/  Collisions are found by sorting the names in memory and comparing the
+/  neighbours, then the records are put back in directory order and a
+/  second walk rewrites the SFN fields of the matching entries in the
+/  window. Only the sectors holding those entries are visited again. In
+/  the new name pattern, '?' takes the character at the same position of
+/  the old name and '*' takes the rest of the name body or extension. */
+
+#define REN_RECSZ	15		/* Work record: new or kept SFN[11], sum, flag, entry index */
+
+static int cmp_rec (	/* <0, 0 or >0 as r1 sorts before, with or after r2 */
+	const BYTE* r1,		/* Work records to compare */
+	const BYTE* r2,
+	int key				/* 0:By sum and name, 1:By entry index */
+)
+{
+	if (key) return (ld_word(r1 + 13) < ld_word(r2 + 13)) ? -1 : (ld_word(r1 + 13) > ld_word(r2 + 13));
+	if (r1[11] != r2[11]) return (int)r1[11] - (int)r2[11];	/* The sum byte settles most of them */
+	return memcmp(r1, r2, 11);
+}
+
+
+static void sort_recs (
+	BYTE* tbl,			/* Table of work records */
+	UINT n,				/* Number of records */
+	int key				/* 0:By sum and name, 1:By entry index */
+)
+{
+	BYTE rec[REN_RECSZ];
+	UINT gap, i, j;
+
+
+	for (gap = 1; gap < n / 3; gap = gap * 3 + 1) ;	/* Shell sort, in place and without recursion */
+	for ( ; gap > 0; gap /= 3) {
+		for (i = gap; i < n; i++) {
+			memcpy(rec, tbl + i * REN_RECSZ, REN_RECSZ);
+			for (j = i; j >= gap && cmp_rec(rec, tbl + (j - gap) * REN_RECSZ, key) < 0; j -= gap) {
+				memcpy(tbl + j * REN_RECSZ, tbl + (j - gap) * REN_RECSZ, REN_RECSZ);
+			}
+			memcpy(tbl + j * REN_RECSZ, rec, REN_RECSZ);
+		}
+	}
+}
+
+
+static FRESULT map_name (	/* FR_OK: successful, FR_INVALID_NAME: new name is not valid */
+	DIR* dp,				/* Directory object to return the new SFN in dp->fn[] */
+	const TCHAR* src,		/* Old file name */
+	const TCHAR* pat		/* New name pattern */
+)
+{
+	TCHAR buf[FF_SFN_BUF + 1];
+	const TCHAR *p;
+	TCHAR c;
+	UINT n, k, f;
+
+
+	n = 0;
+	for (f = 0; f < 2; f++) {				/* Body, then extension */
+		for (k = 0; *pat && *pat != '.'; ) {
+			c = *pat++;
+			if (c == '*') {					/* Take the rest of the field */
+				while (src[k] && src[k] != '.') {
+					if (n >= FF_SFN_BUF) return FR_INVALID_NAME;
+					buf[n++] = src[k++];
+				}
+				continue;
+			}
+			if (c == '?') c = (src[k] && src[k] != '.') ? src[k] : 0;	/* Take the character at this position */
+			if (src[k] && src[k] != '.') k++;
+			if (c) {
+				if (n >= FF_SFN_BUF) return FR_INVALID_NAME;
+				buf[n++] = c;
+			}
+		}
+		while (*src && *src != '.') src++;	/* Go to the next field of the old name */
+		if (*src == '.') src++;
+		if (*pat != '.' || f) break;
+		pat++;
+		if (n >= FF_SFN_BUF) return FR_INVALID_NAME;
+		buf[n++] = '.';
+	}
+	if (*pat) return FR_INVALID_NAME;		/* Too many dots */
+	if (n > 0 && buf[n - 1] == '.') n--;	/* No extension */
+	buf[n] = 0;
+
+	p = buf;
+	if (create_name(dp, &p) != FR_OK || (dp->fn[NSFLAG] & (NS_LAST | NS_DOT)) != NS_LAST) {
+		return FR_INVALID_NAME;				/* Validate and convert it to the SFN */
+	}
+	return FR_OK;
+}
+
+
+FRESULT f_renamefind (
+	DIR* dp,				/* Pointer to the open directory object */
+	const TCHAR* pattern,	/* Pointer to the matching pattern */
+	const TCHAR* newpat,	/* Pointer to the new name pattern */
+	void* work,				/* Pointer to the work area */
+	UINT len,				/* Size of the work area in unit of byte */
+	UINT* nren,				/* Pointer to number of files renamed */
+	void (*func)(const FILINFO*, const FILINFO*)	/* Pointer to the function called with the old and new names (null: none) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	FILINFO fno, fnn;
+	BYTE *tbl = (BYTE*)work, *rec, *r, sum;
+	UINT nrec, cnt, i;
+	WORD idx;
+
+
+	cnt = nrec = 0;
+	res = mount_at(0, &fs, FA_WRITE, dp);	/* Check validity of the directory object */
+
+	/* Read the directory and collect the resulting names */
+	if (res == FR_OK) res = dir_sdi(dp, 0);
+	while (res == FR_OK) {
+		res = DIR_READ_FILE(dp);
+		if (res != FR_OK) break;
+		if (nrec >= len / REN_RECSZ) {
+			res = FR_NOT_ENOUGH_CORE; break;
+		}
+		rec = tbl + nrec * REN_RECSZ;
+		get_fileinfo(dp, &fno);
+		rec[12] = 0;
+		if (dp->dir[DIR_Name] != '.' && pattern_match(pattern, fno.fname, 0, FIND_RECURS)) {
+#if FF_FS_LOCK
+			res = chk_share(dp, 2);			/* Check if it is an open object */
+			if (res != FR_OK) break;
+#endif
+			res = map_name(dp, fno.fname, newpat);	/* Get the new name */
+			if (res != FR_OK) break;
+			memcpy(rec, dp->fn, 11);
+			rec[12] = 1;
+		} else {
+			memcpy(rec, dp->dir, 11);		/* Name is kept */
+		}
+		for (sum = 0, i = 0; i < 11; i++) sum = (BYTE)((sum >> 1) + (sum << 7) + rec[i]);
+		rec[11] = sum;
+		st_word(rec + 13, (WORD)(dp->dptr / SZDIRE));
+		nrec++;
+		res = dir_next(dp, 0);
+	}
+	if (res == FR_NO_FILE) res = FR_OK;
+
+	/* Every new name must be unique in the resulting directory, equal
+	/  names are next to each other once the records are sorted */
+	for (i = 0; res == FR_OK && i < nrec; i++) {
+		if (tbl[i * REN_RECSZ + 12]) cnt++;
+	}
+	if (res == FR_OK && cnt) {
+		sort_recs(tbl, nrec, 0);
+		for (i = 1; i < nrec; i++) {
+			rec = tbl + i * REN_RECSZ;
+			r = rec - REN_RECSZ;
+			if ((rec[12] || r[12]) && !cmp_rec(r, rec, 0)) {
+				res = FR_EXIST; break;
+			}
+		}
+		if (res == FR_OK) sort_recs(tbl, nrec, 1);	/* Back to directory order */
+	}
+
+	/* Walk the directory again and rewrite the matched entries */
+	if (res == FR_OK && cnt) res = dir_sdi(dp, 0);
+	for (i = idx = 0; res == FR_OK && i < nrec; i++) {
+		rec = tbl + i * REN_RECSZ;
+		if (!rec[12]) continue;
+		while (res == FR_OK && idx < ld_word(rec + 13)) {
+			res = dir_next(dp, 0);
+			idx++;
+		}
+		if (res == FR_OK) res = move_window(fs, dp->sect);
+		if (res != FR_OK) break;
+		if (func) get_fileinfo(dp, &fno);
+		memcpy(dp->dir, rec, 11);
+		dp->dir[DIR_NTres] &= ~(NS_BODY | NS_EXT);
+		if (!(dp->dir[DIR_Attr] & AM_DIR)) dp->dir[DIR_Attr] |= AM_ARC;
+		fs->wflag = 1;
+		if (func) {
+			get_fileinfo(dp, &fnn);
+			func(&fno, &fnn);
+		}
+	}
+	if (res == FR_NO_FILE) res = FR_INT_ERR;	/* Directory ended before a matched entry */
+	if (res == FR_OK && cnt) res = sync_fs(fs);
+	if (nren) *nren = (res == FR_OK) ? cnt : 0;
+
+	LEAVE_FF(fs, res);
+}
+#endif
+// WBW (end)
+
+
+
 
 /*-----------------------------------------------------------------------*/
 /* Create a Directory                                                    */
@@ -5700,6 +6585,7 @@ FRESULT f_forward (
 		if (move_window(fs, sect) != FR_OK) ABORT(fs, FR_DISK_ERR);	/* Move sector window to the file data */
 		dbuf = fs->win;
 #else
+		if (GET_FBUF(fp, fp->sect == sect) != FR_OK) ABORT(fs, FR_DISK_ERR);
 		if (fp->sect != sect) {		/* Fill sector cache with file data */
 #if !FF_FS_READONLY
 			if (fp->flag & FA_DIRTY) {		/* Write-back dirty sector cache */
@@ -5724,7 +6610,39 @@ FRESULT f_forward (
 
 
 
-#if !FF_FS_READONLY && FF_USE_MKFS
+// WBW (start)
+#if !FF_FS_READONLY && FF_USE_MKFS && FF_MKFS_OVL
+/*-----------------------------------------------------------------------*/
+/* Get logical drive for f_mkfs() in ffmkfs.c                            */
+/*-----------------------------------------------------------------------*/
+
+int ff_mkfs_vol (			/* Returns logical drive number (-1:invalid drive number or null pointer) */
+	const TCHAR** path		/* Pointer to pointer to the path name */
+)
+{
+	int vol;
+
+
+	vol = get_ldnumber(path);
+	if (vol >= 0 && FatFs[vol]) FatFs[vol]->fs_type = 0;	/* Clear the fs object if mounted */
+	return vol;
+}
+#endif
+#endif	/* !FF_MKFS_PART */
+
+#if FF_MKFS_OVL
+#if FF_FS_EXFAT || FF_LBA64 || FF_USE_LFN == 3
+#error FF_MKFS_OVL cannot be used with exFAT, GPT or LFN on the heap
+#endif
+int ff_mkfs_vol (const TCHAR** path);
+#endif
+
+// WBW (end)
+
+// WBW (start)
+//#if !FF_FS_READONLY && FF_USE_MKFS
+#if !FF_FS_READONLY && FF_USE_MKFS && (!FF_MKFS_OVL || FF_MKFS_PART)	/* With FF_MKFS_OVL, only in ffmkfs.c */
+// WBW (end)
 /*-----------------------------------------------------------------------*/
 /* Create FAT/exFAT volume (with sub-functions)                          */
 /*-----------------------------------------------------------------------*/
@@ -5904,9 +6822,16 @@ FRESULT f_mkfs (
 
 
 	/* Check mounted drive and clear work area */
+	// WBW (start)
+#if FF_MKFS_OVL
+	vol = ff_mkfs_vol(&path);					/* Get target logical drive and clear the fs object if mounted */
+	if (vol < 0) return FR_INVALID_DRIVE;
+#else
 	vol = get_ldnumber(&path);					/* Get target logical drive */
 	if (vol < 0) return FR_INVALID_DRIVE;
 	if (FatFs[vol]) FatFs[vol]->fs_type = 0;	/* Clear the fs object if mounted */
+#endif
+	// WBW (end)
 	pdrv = LD2PD(vol);		/* Hosting physical drive */
 	ipart = LD2PT(vol);		/* Hosting partition (0:create as new, 1..:existing partition) */
 
@@ -6437,6 +7362,12 @@ FRESULT f_fdisk (
 
 
 
+// WBW (start)
+#if !FF_MKFS_PART
+// WBW (end)
+
+
+
 
 #if FF_USE_STRFUNC
 #if FF_USE_LFN && FF_LFN_UNICODE && (FF_STRF_ENCODE < 0 || FF_STRF_ENCODE > 3)
@@ -7104,4 +8035,6 @@ FRESULT f_setcp (
 	return FR_OK;
 }
 #endif	/* FF_CODE_PAGE == 0 */
-
+// WBW (start)
+#endif	/* !FF_MKFS_PART */
+// WBW (end)
@@ -129,6 +129,15 @@ extern const char* VolumeStr[FF_VOLUMES];	/* User defied volume ID */
 
 /* Filesystem object structure (FATFS) */
 
+#if (FF_FS_FATTYPES & 7) == 0 || (FF_FS_FATTYPES & ~7)
+#error Wrong FF_FS_FATTYPES setting
+#endif
+#define FF_FAT_MULTI	(FF_FS_EXFAT || (FF_FS_FATTYPES & (FF_FS_FATTYPES - 1)))	/* FAT accessors bound at mount */
+
+#if FF_FS_FILPOOL && FF_FS_TINY
+#error FF_FS_FILPOOL cannot be used with FF_FS_TINY
+#endif
+
 typedef struct {
 	BYTE	fs_type;		/* Filesystem type (0:not mounted) */
 	BYTE	pdrv;			/* Volume hosting physical drive */
@@ -139,8 +148,10 @@ typedef struct {
 	WORD	id;				/* Volume mount ID */
 	WORD	n_rootdir;		/* Number of root directory entries (FAT12/16) */
 	WORD	csize;			/* Cluster size [sectors] */
+	BYTE	csize_sh;		/* Cluster size shift (log2 of csize) */
 #if FF_MAX_SS != FF_MIN_SS
 	WORD	ssize;			/* Sector size (512, 1024, 2048 or 4096) */
+	BYTE	ssize_sh;		/* Sector size shift (log2 of ssize) */
 #endif
 #if FF_USE_LFN
 	WCHAR*	lfnbuf;			/* LFN working buffer */
@@ -168,9 +179,18 @@ typedef struct {
 	LBA_t	database;		/* Data base sector */
 #if FF_FS_EXFAT
 	LBA_t	bitbase;		/* Allocation bitmap base sector */
+#endif
+#if FF_FAT_MULTI
+	const void*	facc;		/* FAT entry accessor set of the FAT sub-type */
 #endif
 	LBA_t	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[FF_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if FF_FS_FILPOOL
+	void*	pown[FF_FS_FILPOOL];	/* File object using each buffer in pbuf[] (0:free) */
+	WORD	puse[FF_FS_FILPOOL];	/* Last use of each buffer in pbuf[] */
+	WORD	ptick;			/* Use counter for pbuf[] */
+	BYTE	pbuf[FF_FS_FILPOOL][FF_MAX_SS];	/* Sector buffer pool for file data */
+#endif
 } FATFS;
 
 
@@ -204,6 +224,7 @@ typedef struct {
 	FFOBJID	obj;			/* Object identifier (must be the 1st member to detect invalid object pointer) */
 	BYTE	flag;			/* File status flags */
 	BYTE	err;			/* Abort flag (error code) */
+	BYTE	created;		/* The file did not exist and was created by f_open() */
 	FSIZE_t	fptr;			/* File read/write pointer (Zeroed on file open) */
 	DWORD	clust;			/* Current cluster of fpter (invalid when fptr is 0) */
 	LBA_t	sect;			/* Sector number appearing in buf[] (0:invalid) */
@@ -214,7 +235,9 @@ typedef struct {
 #if FF_USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (nulled on open, set by application) */
 #endif
-#if !FF_FS_TINY
+#if FF_FS_FILPOOL
+	BYTE*	buf;			/* File data read/write window taken from FATFS.pbuf[] (0:none) */
+#elif !FF_FS_TINY
 	BYTE	buf[FF_MAX_SS];	/* File private data read/write window */
 #endif
 } FIL;
@@ -242,11 +265,18 @@ typedef struct {
 
 /* File information structure (FILINFO) */
 
+#if FF_DIR_WALK && FF_FS_EXFAT
+#error FF_DIR_WALK cannot be used with exFAT
+#endif
+
 typedef struct {
 	FSIZE_t	fsize;			/* File size */
 	WORD	fdate;			/* Modified date */
 	WORD	ftime;			/* Modified time */
 	BYTE	fattrib;		/* File attribute */
+#if FF_DIR_WALK
+	DWORD	fclust;			/* Object start cluster (0:root or empty file) */
+#endif
 #if FF_USE_LFN
 	TCHAR	altname[FF_SFN_BUF + 1];/* Alternative file name */
 	TCHAR	fname[FF_LFN_BUF + 1];	/* Primary file name */
@@ -308,15 +338,22 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data t
 FRESULT f_lseek (FIL* fp, FSIZE_t ofs);								/* Move file pointer of the file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate the file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of the writing file */
+FRESULT f_futime (FIL* fp, const FILINFO* fno);						/* Change timestamp of an open file */
 FRESULT f_opendir (DIR* dp, const TCHAR* path);						/* Open a directory */
 FRESULT f_closedir (DIR* dp);										/* Close an open directory */
 FRESULT f_readdir (DIR* dp, FILINFO* fno);							/* Read a directory item */
 FRESULT f_findfirst (DIR* dp, FILINFO* fno, const TCHAR* path, const TCHAR* pattern);	/* Find first file */
 FRESULT f_findnext (DIR* dp, FILINFO* fno);							/* Find next file */
+FRESULT f_dirat (DIR* dp, DWORD sclust, DWORD ofs);					/* Move an open directory object to a directory by its start cluster */
 FRESULT f_mkdir (const TCHAR* path);								/* Create a sub directory */
 FRESULT f_unlink (const TCHAR* path);								/* Delete an existing file or directory */
 FRESULT f_rename (const TCHAR* path_old, const TCHAR* path_new);	/* Rename/Move a file or directory */
 FRESULT f_stat (const TCHAR* path, FILINFO* fno);					/* Get file status */
+FRESULT f_openat (FIL* fp, const DIR* at, const TCHAR* path, BYTE mode);	/* Open or create a file in an open directory */
+FRESULT f_statat (const DIR* at, const TCHAR* path, FILINFO* fno);	/* Get file status in an open directory */
+FRESULT f_unlinkat (const DIR* at, const TCHAR* path);				/* Delete a file or directory in an open directory */
+FRESULT f_unlinkfind (DIR* dp, const TCHAR* pattern, UINT* ndel, void (*func)(const FILINFO*));	/* Delete matching files and empty sub-directories in an open directory */
+FRESULT f_renamefind (DIR* dp, const TCHAR* pattern, const TCHAR* newpat, void* work, UINT len, UINT* nren, void (*func)(const FILINFO*, const FILINFO*));	/* Rename matching files in an open directory by a name pattern */
 FRESULT f_chmod (const TCHAR* path, BYTE attr, BYTE mask);			/* Change attribute of a file/dir */
 FRESULT f_utime (const TCHAR* path, const FILINFO* fno);			/* Change timestamp of a file/dir */
 FRESULT f_chdir (const TCHAR* path);								/* Change current directory */
@@ -360,6 +397,12 @@ DWORD get_fattime (void);	/* Get current time */
 #endif
 
 
+/* CRC32 function */
+#if FF_USE_CRC32
+DWORD ff_crc32 (DWORD crc, const void* buf, UINT len);	/* Update CRC32 register (start with 0xFFFFFFFF, invert at end) */
+#endif
+
+
 /* LFN support functions (defined in ffunicode.c) */
 
 #if FF_USE_LFN >= 1
@@ -231,6 +231,17 @@
 /  buffer in the filesystem object (FATFS) is used for the file data transfer. */
 
 
+#define FF_FS_FILPOOL	1
+/* This option sets the number of sector buffers in the file data buffer pool of
+/  each filesystem object (FATFS). (0:Disable or 1-8)
+/  When enabled, file objects (FIL) do not have a private sector buffer. An open
+/  file borrows one from the pool of its volume when it needs it and gives it back
+/  at f_close(). If all are in use, the least recently used one is taken from its
+/  file, writing back its data first. Full sectors are read and written directly
+/  to the caller's buffer in any case, so one buffer serves a copy between two
+/  files of the same volume well. This option cannot be used with FF_FS_TINY. */
+
+
 #define FF_FS_EXFAT		0
 /* This option switches support for exFAT filesystem. (0:Disable or 1:Enable)
 /  To enable exFAT, also LFN needs to be enabled. (FF_USE_LFN >= 1)
@@ -293,4 +304,64 @@
 
 
 
+/*---------------------------------------------------------------------------/
+/ RomWBW (Z80) Configurations
+/---------------------------------------------------------------------------*/
+
+#define FF_Z80_MEMOPS	1
+/* This option selects the Z80 assembler helpers (ffz80.c) used for the
+/  little-endian load/store functions and the block copy/fill on the file data
+/  and directory hot paths. It only takes effect when compiled by SDCC for the
+/  Z80. Any other compiler always uses the portable C code.
+/
+/   0: Portable C code and the C library memcpy()/memset()
+/   1: Assembler helpers with LDIR based block copy/fill
+/   2: Assembler helpers with unrolled LDI block copy/fill (faster, but larger) */
+
+
+#define FF_FS_FATTYPES	7
+/* This option selects the FAT sub-types to be supported by bit mapping.
+/  Volumes of a sub-type that is not selected are rejected with FR_NO_FILESYSTEM.
+/  f_mkfs() is not affected and can still create any sub-type.
+/
+/   bit0=1: FAT12
+/   bit1=1: FAT16
+/   bit2=1: FAT32
+/
+/  When a single sub-type is selected, the FAT entry access is compiled for that
+/  sub-type only and the code for the others is dropped. Otherwise, the accessor
+/  set of the detected sub-type is bound to the volume at mount time. */
+
+
+#define FF_MKFS_OVL	1
+/* This option moves f_mkfs() out of ff.c into ffmkfs.c, so that it can be
+/  linked into an overlay that is loaded only when a volume is formatted. ff.c
+/  keeps ff_mkfs_vol() for it to clear a mounted volume. This option cannot be
+/  used with exFAT, GPT (FF_LBA64) or FF_USE_LFN == 3.
+/
+/   0: f_mkfs() is in ff.c
+/   1: f_mkfs() is in ffmkfs.c */
+
+
+#define FF_DIR_WALK	1
+/* This option adds the start cluster of the object (fclust) to FILINFO and
+/  f_dirat(), which moves an open directory object to any directory of the same
+/  volume given by its start cluster and an offset in it. Together they let an
+/  application walk a directory tree with a single directory object and without
+/  following paths again. This option cannot be used with exFAT.
+/
+/   0: Disable directory walk support
+/   1: Enable directory walk support */
+#define FF_USE_CRC32	1
+/* This option switches the table driven CRC32 function ff_crc32(), which is
+/  also used for the GPT header check. The tables are built on first use. With
+/  the Z80 assembler helpers (FF_Z80_MEMOPS) one 256 entry table is kept as byte
+/  planes (1279 bytes with alignment), otherwise slicing-by-8 is used with 8KB
+/  of tables.
+/
+/   0: Disable ff_crc32()
+/   1: Enable ff_crc32() */
+
+
+
 /*--- End of configuration options ---*/
@@ -0,0 +1,13 @@
+/*----------------------------------------------------------------------------/
+/  f_mkfs() of FatFs built as a module of its own                             /
+/-----------------------------------------------------------------------------/
+/
+/ With FF_MKFS_OVL, ff.c leaves out f_mkfs() and this file compiles it (and
+/ the few private functions it needs) from ff.c alone.  It is linked into the
+/ FORMAT overlay of FAT.COM, so the code is only loaded when it is used.
+/
+/----------------------------------------------------------------------------*/
+
+#define FF_MKFS_PART	1	/* Only f_mkfs() and what it needs from ff.c */
+
+#include "ff.c"
@@ -0,0 +1,286 @@
+/*************************************************************************
+*  ffz80.c
+*
+*  Z80 helpers for the FatFs hot paths.  The Z80 is little-endian, so
+*  the FAT structure load/store functions reduce to plain byte moves.
+*************************************************************************/
+
+#include "ffz80.h"
+
+#if FF_Z80_ASM
+
+WORD ff_ld_word(const BYTE* ptr) __naked
+{
+	ptr;
+
+	__asm
+
+	// ptr in HL, result in DE
+	ld		e,(hl)
+	inc		hl
+	ld		d,(hl)
+	ret
+
+	__endasm;
+}
+
+DWORD ff_ld_dword(const BYTE* ptr) __naked
+{
+	ptr;
+
+	__asm
+
+	// ptr in HL, result in HLDE
+	ld		e,(hl)
+	inc		hl
+	ld		d,(hl)
+	inc		hl
+	ld		a,(hl)
+	inc		hl
+	ld		h,(hl)
+	ld		l,a
+	ret
+
+	__endasm;
+}
+
+void ff_st_word(BYTE* ptr, WORD val) __naked
+{
+	ptr;
+	val;
+
+	__asm
+
+	// ptr in HL, val in DE
+	ld		(hl),e
+	inc		hl
+	ld		(hl),d
+	ret
+
+	__endasm;
+}
+
+void ff_st_dword(BYTE* ptr, DWORD val) __sdcccall(0) __naked
+{
+	ptr;
+	val;
+
+	__asm
+
+	// Get ptr into DE, leave HL pointing to val
+	ld		hl,#2
+	add		hl,sp
+	ld		e,(hl)
+	inc		hl
+	ld		d,(hl)
+	inc		hl
+
+	// val is already little-endian on the stack
+	ldi
+	ldi
+	ldi
+	ldi
+	ret
+
+	__endasm;
+}
+
+void ff_memcpy(void* dst, const void* src, UINT cnt) __sdcccall(0) __naked
+{
+	dst;
+	src;
+	cnt;
+
+	__asm
+
+	// Get dst into DE, src into BC, cnt into HL
+	ld		hl,#2
+	add		hl,sp
+	ld		e,(hl)
+	inc		hl
+	ld		d,(hl)
+	inc		hl
+	ld		c,(hl)
+	inc		hl
+	ld		b,(hl)
+	inc		hl
+	ld		a,(hl)
+	inc		hl
+	ld		h,(hl)
+	ld		l,a
+
+	// Swap to HL := src, BC := cnt
+	push	hl
+	ld		h,b
+	ld		l,c
+	pop		bc
+
+	ld		a,b
+	or		c
+	ret		z				; nothing to copy
+
+#if FF_Z80_MEMOPS == 2
+ldiblk:
+	// Move 16 bytes per pass while at least 16 remain
+	ld		a,b
+	or		a
+	jr		nz,ldi16		; 256 or more left
+	ld		a,c
+	cp		#16
+	jr		c,ldirem		; less than 16 left
+ldi16:
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	ldi
+	jr		ldiblk
+ldirem:
+	or		a				; A still has remaining count
+	ret		z
+#endif
+
+	ldir
+	ret
+
+	__endasm;
+}
+
+void ff_memset(void* dst, int val, UINT cnt) __sdcccall(0) __naked
+{
+	dst;
+	val;
+	cnt;
+
+	__asm
+
+	// Get dst into DE, val into A, cnt into BC
+	ld		hl,#2
+	add		hl,sp
+	ld		e,(hl)
+	inc		hl
+	ld		d,(hl)
+	inc		hl
+	ld		a,(hl)
+	inc		hl
+	inc		hl
+	ld		c,(hl)
+	inc		hl
+	ld		b,(hl)
+
+	ex		de,hl			; HL := dst
+	ld		e,a				; save fill value
+
+	ld		a,b
+	or		c
+	ret		z				; nothing to fill
+
+	// Seed the first byte and let the copy propagate it
+	ld		(hl),e
+	dec		bc
+	ld		a,b
+	or		c
+	ret		z				; single byte fill
+	ld		d,h
+	ld		e,l
+	inc		de
+
+#if FF_Z80_MEMOPS == 2
+	jp		ldiblk			; share unrolled loop in ff_memcpy
+#else
+	ldir
+	ret
+#endif
+
+	__endasm;
+}
+
+DWORD ff_crc32_z80(DWORD crc, const BYTE* buf, UINT len, const BYTE* tab) __sdcccall(0) __naked
+{
+	crc;
+	buf;
+	len;
+	tab;
+
+	__asm
+
+	push	ix
+	ld		ix,#0
+	add		ix,sp
+
+	// buf in HL, len in BC
+	ld		l,8(ix)
+	ld		h,9(ix)
+	ld		c,10(ix)
+	ld		b,11(ix)
+
+	// Alternate set: crc in E,D,C,B (LSB first), H' := page of
+	// the first byte plane of the table (256 byte aligned)
+	exx
+	ld		e,4(ix)
+	ld		d,5(ix)
+	ld		c,6(ix)
+	ld		b,7(ix)
+	ld		h,13(ix)
+	exx
+
+	// Nothing to do for len == 0
+	ld		a,b
+	or		c
+	jr		z,crcdone
+
+crcloop:
+	// crc := (crc >> 8) ^ tab[(crc ^ byte) & 0xFF], one byte
+	// plane of the table at a time
+	ld		a,(hl)
+	inc		hl
+	exx
+	xor		e
+	ld		l,a
+	ld		a,(hl)
+	xor		d
+	ld		e,a
+	inc		h
+	ld		a,(hl)
+	xor		c
+	ld		d,a
+	inc		h
+	ld		a,(hl)
+	xor		b
+	ld		c,a
+	inc		h
+	ld		b,(hl)
+	dec		h
+	dec		h
+	dec		h
+	exx
+	dec		bc
+	ld		a,b
+	or		c
+	jr		nz,crcloop
+
+crcdone:
+	// Result in DEHL
+	exx
+	ld		l,e
+	ld		h,d
+	ld		e,c
+	ld		d,b
+	pop		ix
+	ret
+
+	__endasm;
+}
+
+#endif /* FF_Z80_ASM */
@@ -0,0 +1,27 @@
+#ifndef _FFZ80_H
+#define _FFZ80_H
+
+#include "ff.h"
+
+#if defined(__SDCC_z80) && FF_Z80_MEMOPS
+
+#define FF_Z80_ASM 1
+
+WORD ff_ld_word(const BYTE* ptr) __naked;
+DWORD ff_ld_dword(const BYTE* ptr) __naked;
+void ff_st_word(BYTE* ptr, WORD val) __naked;
+void ff_st_dword(BYTE* ptr, DWORD val) __sdcccall(0) __naked;
+void ff_memcpy(void* dst, const void* src, UINT cnt) __sdcccall(0) __naked;
+void ff_memset(void* dst, int val, UINT cnt) __sdcccall(0) __naked;
+DWORD ff_crc32_z80(DWORD crc, const BYTE* buf, UINT len, const BYTE* tab) __sdcccall(0) __naked;
+
+#else
+
+#define FF_Z80_ASM 0
+
+#define ff_memcpy(dst, src, cnt) memcpy(dst, src, cnt)
+#define ff_memset(dst, val, cnt) memset(dst, val, cnt)
+
+#endif
+
+#endif /* _FFZ80_H */
@@ -0,0 +1,21 @@
+;--------------------------------------------------------------------------
+;  ovlfmt.s - Header of the FORMAT overlay (FATFMT.OVL)
+;
+;  The overlay holds f_mkfs() (ffmkfs.c).  It is linked to run at
+;  heap_start of FAT.COM, using the global symbols of FAT.COM (see
+;  Build.cmd), and loaded there by OvlLoad() in fat.c.
+;--------------------------------------------------------------------------
+
+	.module ovlfmt
+	.globl	_f_mkfs
+	.globl	_heap_start
+
+	;; Ordering of segments for the linker.
+	.area	_CODE
+	.area	_INITIALIZER
+	.area	_DATA
+	.area	_BSS
+
+	.area	_CODE
+	jp	_f_mkfs		; entry, called as f_mkfs()
+	.dw	_heap_start	; FAT.COM this overlay belongs to
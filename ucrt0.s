@@ -31,6 +31,7 @@
 	.globl	l__INITIALIZER, s__INITIALIZED, s__INITIALIZER
 	.globl	l__DATA, s__DATA
 	.globl	___sdcc_external_startup
+	.globl	_conflush
 
 	;; Ordering of segments for the linker.
 	.area	_HEADER (ABS)
@@ -76,6 +77,10 @@ _exit::
 	ex	de,hl		; move exit code hl->de, fall thru
 
 __exit:
+	push	de		; save exit code
+	call	_conflush	; write pending console output
+	pop	de
+
 	; Map return code in de to CP/M 3 conventions:
 	;   0x0000-0xFEFF for success
 	;   0xFF00-0xFFFE for failure
@@ -89,6 +94,13 @@ __exit:
 
 	jp	0		; back to CP/M
 
+_getsp::
+	;; Return caller's stack pointer in de
+	ld	hl, #2		; skip our return address
+	add	hl, sp
+	ex	de, hl
+	ret
+
 argv:	.dw	__main		; name of program
 	.dw	0x0081		; CP/M command args
 	.dw	0		; final null (mandatory per C lang spec)
@@ -128,3 +140,8 @@ gsinit_next:
 
 	.area	_GSFINAL
 	ret
+
+	.area	_HEAP
+	;; Last area in memory, free TPA starts here and runs up to
+	;; the stack.
+_heap_start::